@@ -38,41 +38,364 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 ******/
 
+#define _DEFAULT_SOURCE  // madvise() under -std=c99/c11
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#include <locale.h>
+#include <errno.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "json.h"
+#include "json_pow5.h"
 
 #ifndef NAN
 #define NAN    0
 #endif
 
-int json_error = 0;
+// see the note above json_t before changing its layout
+_Static_assert(sizeof(json_t)<=40, "json_t grew past 40 bytes");
+
+__thread int json_error = 0;  // per thread, the line workers parse concurrently
+
+/* allocator and stats in effect on a thread */
+typedef struct jsonAllocScope_t {
+    const jsonAllocator_t *alloc;
+    jsonAllocStats_t *stats;
+} jsonAllocScope_t;
+
+typedef struct jsonWriter_t {
+    char *buf;
+    size_t size;  // capacity of buf, 0 to measure only
+    size_t len;   // length of the full output so far
+} jsonWriter_t;
+
+/* arrays and objects being walked without recursion, innermost on top */
+typedef struct jsonFrame_t {
+    json_t *node;
+    json_t *tail;    // last member linked so far
+    json_t *src;     // next member to copy
+    int count;
+} jsonFrame_t;
+
+#define JSON_FRAME_LOCAL 32  // frames kept on the C stack
+
+/* an interned label, the text follows the header */
+typedef struct jsonKey_t {
+    uint32_t hash;
+    uint32_t len;
+    char str[];
+} jsonKey_t;
+
+struct jsonKeys_t {
+    pthread_mutex_t lock;
+    bool shared;        // lock around interning
+    jsonKey_t **slot;
+    size_t count, size;
+    jsonArena_t *arena; // the keys themselves
+};
+
+/* state of the tree builder over _saxParse() */
+typedef struct jsonBuilder_t {
+    jsonArena_t *arena;
+    bool insitu;
+    jsonKeys_t *keys;  // labels interned, optional
+    int maxDepth;      // nesting limit
+
+    jsonFrame_t local[JSON_FRAME_LOCAL];
+    jsonFrame_t *stack;
+    int depth;
+    int size;
+
+    json_t *root;
+    char *label;     // of the member to come
+    char labelBuf[JSON_INLINE];  // a short one, goes into the node
+    size_t labelLen;
+} jsonBuilder_t;
+
+/* state carried between the blocks of the structural index */
+typedef struct jsonStage1_t {
+    uint64_t oddRun;    // the block before ended on an odd backslash run
+    uint64_t inString;  // ... inside a string (all ones)
+    uint64_t delim;     // ... on whitespace or an operator (bit 0)
+} jsonStage1_t;
+
+/* grow-only buffer for strings that need unescaping */
+typedef struct jsonScratch_t {
+    char *buf;
+    size_t size;
+} jsonScratch_t;
+
+/* containers open in _unpackSax() */
+typedef struct jsonPackFrame_t {
+    uint64_t count;  // values still to come
+    bool object;
+} jsonPackFrame_t;
+
+/* newline delimited input, see jsonLinesParse() */
+#define JSON_LINES_CHUNK    (1<<20)  // bytes per chunk, cut at a line end
+#define JSON_LINES_QUEUE    16       // chunks waiting for a worker
+#define JSON_LINES_THREADS  64
+
+typedef struct jsonLinesChunk_t {
+    const char *data;
+    size_t len;
+    size_t offset;  // of data in the whole input
+    size_t seq;
+    char *owned;    // buffer read from a stream, freed once parsed
+} jsonLinesChunk_t;
+
+/* shared state of the worker pool */
+typedef struct jsonLines_t {
+    pthread_mutex_t lock;
+    pthread_cond_t more;   // a chunk queued or the input ended
+    pthread_cond_t room;   // a queue slot freed
+    pthread_cond_t turn;   // ordered delivery moved on
+    jsonLinesChunk_t queue[JSON_LINES_QUEUE];
+    int head, queued;
+    size_t seq;            // next chunk to queue
+    size_t deliver;        // next chunk to deliver when ordered
+    size_t count;          // values delivered
+    bool done, stop, ordered;
+    jsonLineFn_t fn;
+    void *ctx;
+    jsonAllocScope_t scope;  // of the caller, taken over by the workers
+} jsonLines_t;
+
+/* a parsed line waiting for its delivery */
+typedef struct jsonLineValue_t {
+    json_t *value;
+    size_t offset;
+} jsonLineValue_t;
+
+/* input of _linesProduceBuffer() */
+typedef struct jsonLinesBuffer_t {
+    const char *buf;
+    size_t len;
+} jsonLinesBuffer_t;
+
+/* tape files, see jsonTapeSave() */
+#define JSON_TAPE_MAGIC  "JTAP"
+#define JSON_TAPE_ORDER  0x01020304  // tapes are read in the writer's byte order
+
+typedef struct jsonTapeNode_t {
+    uint64_t value;   // integer, numeric bits, boolean, string in the pool, or member table
+    uint64_t label;   // in the pool, 0 is the empty string
+    uint32_t count;   // members of an array/object, length of a string
+    uint32_t type;
+} jsonTapeNode_t;
+
+typedef struct jsonTapeSlot_t {
+    uint32_t hash;
+    uint32_t member;  // position + 1, 0 for an empty slot
+} jsonTapeSlot_t;
+
+typedef struct jsonTapeHead_t {
+    char magic[4];
+    uint32_t order;
+    uint64_t pool;      // offset of the string pool, the end of the records
+    uint64_t poolSize;
+    jsonTapeNode_t root;
+} jsonTapeHead_t;
+
+/* containers waiting for their member tables, breadth first */
+typedef struct jsonTapeQueue_t {
+    uint64_t rec;
+    const void *node;   // json_t being written, jsonTapeNode_t being built from
+    json_t *value;
+} jsonTapeQueue_t;
+
+typedef struct jsonTapeWriter_t {
+    char *area;        // header and records
+    size_t len, size;
+    char *pool;
+    size_t poolLen, poolSize;
+    uint64_t *dedup;   // pool offsets + 1 by hash
+    size_t dedupCount, dedupSize;
+} jsonTapeWriter_t;
+
+struct jsonTape_t {
+    const char *map;
+    size_t size;
+    const char *pool;
+    size_t poolSize;
+    jsonArena_t *arena;  // queried values
+};
+
+/* a free block of the node pool, linked into a thread cache or a batch */
+typedef struct jsonPoolBlock_t {
+    struct jsonPoolBlock_t *next;
+    struct jsonPoolBlock_t *batch;  // next batch in the depot, batch heads only
+} jsonPoolBlock_t;
+
+typedef struct jsonPoolCache_t {
+    jsonPoolBlock_t *head;
+    int count;
+} jsonPoolCache_t;
+
+#define JSON_POOL_MIN      16  // smallest block pooled
+#define JSON_POOL_CLASSES   7  // 16, 24, ... 64 bytes
+#define JSON_POOL_BATCH    64  // blocks moved between a cache and the depot
+#define JSON_POOL_DEPOT   256  // batches kept per class, the rest is freed
 
 ///TODO: Check parsing empty array or object
 
 /* forward reference declaration */
 bool _jsonFillZero(json_t *dst);
+char *_inlineText(json_t *node, const char *str, size_t len, bool label);
+void *_stackGrow(void *stack, void *local, int *size, size_t elem);
+
+void *_stdMalloc(void *ctx, size_t size);
+void *_stdRealloc(void *ctx, void *ptr, size_t size);
+void _stdFree(void *ctx, void *ptr);
+size_t _stdUsable(void *ctx, void *ptr);
+bool _statsRoom(jsonAllocStats_t *stats, size_t size);
+void _statsTake(jsonAllocStats_t *stats, size_t size);
+void _statsGive(jsonAllocStats_t *stats, size_t size);
+const jsonAllocator_t *_allocator(void);
+size_t _usable(const jsonAllocator_t *alloc, void *ptr);
+void *_memZero(size_t count, size_t size);
+jsonAllocScope_t _scopeEnter(const jsonAllocator_t *alloc, jsonAllocStats_t *stats);
+void _scopeLeave(jsonAllocScope_t scope);
+
+bool _jsonArenaGrow(jsonArena_t *arena, size_t size);
+void _jsonArenaRecycle(jsonArena_t *arena);
+json_t *_newNode(jsonArena_t *arena);
+
+int _poolClass(size_t size);
+bool _poolPush(int c, jsonPoolBlock_t *batch);
+jsonPoolBlock_t *_poolPop(int c);
+void _poolRelease(void *cache);
+void _poolKey(void);
+jsonPoolCache_t *_poolCache(void);
+
+uint32_t _jsonHash(const char *str, size_t len);
+void _indexInsert(struct jsonIndex_t *index, json_t *member);
+json_t *_indexLookup(struct jsonIndex_t *index, const char *key, uint32_t hash);
+jsonArena_t *_listArena(json_t *list);
+void _listSetArena(json_t *list, jsonArena_t *arena);
+struct jsonIndex_t *_indexBuild(json_t *list);
+struct jsonIndex_t *_indexOf(json_t *list);
+void _indexDrop(json_t *list);
+struct jsonIndex_t *_indexFix(json_t *list);
+void _indexRehash(struct jsonIndex_t *index);
+uint32_t _labelHash(json_t *member);
+void _indexFile(struct jsonIndex_t *index, json_t *member, uint32_t pos);
+struct jsonSlot_t *_indexSlot(struct jsonIndex_t *index, const char *key, uint32_t hash);
+bool _indexCurrent(struct jsonIndex_t *index);
+void _indexAppend(json_t *list, json_t *member);
+json_t *_objectMember(json_t *object, const char *key, uint32_t hash);
+
+jsonKey_t *_keyOf(const char *label);
+bool _labelIs(json_t *member, const char *key, uint32_t hash);
+char *_keysIntern(jsonKeys_t *keys, const char *str, size_t len);
+json_t *_arrayMember(json_t *array, int n);
+
+void _jsonSimdInit(void);
 
 char *_skipWhitespace(char **src);
 int _getString(char **src, char *buf);
-json_t *_buildValue(char **src);
+int _measureString(const char *src);
+char *_takeString(char **src, jsonArena_t *arena, bool insitu);
+bool _eiselLemire(uint64_t w, int64_t q, bool neg, double *rval);
+double _slowNumber(const char *start, const char *end);
+int _getNumber(char **src, int64_t *integer, double *numeric);
+json_t *_matchScalar(char **src, jsonArena_t *arena, bool insitu);
+int _getLiteral(char **src, bool *boolean);
+bool _viewString(char **src, bool insitu, jsonScratch_t *scratch, const char **str, size_t *len);
+int _maxDepth(void);
+bool _saxParse(char **src, const jsonSax_t *sax, void *ctx, bool insitu, jsonScratch_t *scratch, int maxDepth);
+char *_buildText(jsonBuilder_t *b, const char *str, size_t len);
+bool _buildAttach(jsonBuilder_t *b, json_t *value);
+bool _buildRun(jsonBuilder_t *b, char **src, jsonScratch_t *scratch);
+bool _buildOpen(jsonBuilder_t *b, bool object);
+json_t *_buildValue(char **src, jsonArena_t *arena, bool insitu, jsonKeys_t *keys);
+json_t *_jsonParseN(const char *buf, size_t len, jsonArena_t *arena);
 
 bool _jsonSetArray(json_t *dst, json_t *value, bool ref);
 bool _jsonSetObject(json_t *dst, json_t *value, bool ref);
 
-int _strcpyToJsonEsc(char *dest, char *src);
+int _countDigits(uint64_t u);
+void _writeDigits(char *buf, uint64_t u, int n);
+int _formatInteger(char *buf, int64_t value);
+void _schubfachG(int k, uint64_t *g1, uint64_t *g0);
+uint64_t _schubfachRop(uint64_t g1, uint64_t g0, uint64_t cp);
+void _schubfach(int q, uint64_t c, uint64_t *f, int *e);
+int _formatNumeric(char *buf, double value);
+
+void _writeRaw(jsonWriter_t *w, const char *str, size_t n);
+void _writeChar(jsonWriter_t *w, char c);
+void _writeEsc(jsonWriter_t *w, const char *src);
 
 json_t *_queryArray(json_t *value, char **src);
 json_t *_queryObject(json_t *value, char **src);
 
-void _fillPureValStrBuf(json_t *value, bool esc, char *buf, int *idx);
-void _fillOptStrBuf(json_t *value, char *buf, int *idx);
-
-json_t *_jsonCopy(json_t *value, bool expand);
+void _fillPureValStrBuf(json_t *value, bool esc, jsonWriter_t *w);
+void _writeLead(jsonWriter_t *w, json_t *list, json_t *member);
+bool _fillOptStrBuf(json_t *value, jsonWriter_t *w);
+bool _jsonWrite(json_t *value, bool json, jsonWriter_t *w);
+
+json_t *_jsonCopy(json_t *value, bool label);
+
+int _pathParse(const char *str, jsonPathSeg_t *seg, char *keys);
+json_t *_pathStep(json_t *value, const jsonPathSeg_t *seg);
+bool _pathSegEq(const jsonPathSeg_t *a, const jsonPathSeg_t *b);
+void _pathExtract(json_t *value, jsonPath_t **paths, int *sel, int n, int depth, json_t **results);
+
+uint64_t _escapedBits(jsonStage1_t *st, uint64_t bs);
+uint64_t _prefixXor(uint64_t x);
+uint64_t _stage1Block(jsonStage1_t *st, const char *blk);
+uint32_t *_jsonStage1(const char *src, size_t len, size_t *count);
+bool _jsonBoundary(const char *src, size_t len, size_t *first, size_t *last);
+
+size_t _docSkip(jsonDoc_t *doc, size_t i);
+size_t _docStep(jsonDoc_t *doc, size_t i, const jsonPathSeg_t *seg);
+
+bool _pushToken(jsonParser_t *p, const char *src, size_t len);
+void _pushAttach(jsonParser_t *p, json_t *value);
+bool _pushOpen(jsonParser_t *p, char c);
+bool _pushClose(jsonParser_t *p, char c);
+bool _pushFinish(jsonParser_t *p);
+void _pushFail(jsonParser_t *p);
+json_t *_parserParse(jsonParser_t *p, const char *buf, size_t len);
+json_t *_parserFeed(jsonParser_t *p, const char *buf, size_t len);
+
+void *_linesWorker(void *arg);
+bool _linesQueue(jsonLines_t *lines, const char *data, size_t len, size_t offset, char *owned);
+int64_t _linesRun(int threads, bool ordered, jsonLineFn_t fn, void *ctx, 
+                  bool (*produce)(jsonLines_t *lines, void *src), void *src);
+bool _linesProduceBuffer(jsonLines_t *lines, void *src);
+bool _linesProduceStream(jsonLines_t *lines, void *src);
+
+void _packRaw(jsonWriter_t *w, const void *src, size_t n);
+void _packUint(jsonWriter_t *w, uint8_t c, uint64_t u, int n);
+void _packLen(jsonWriter_t *w, uint8_t fix, uint32_t fixMax, uint8_t c8, uint8_t c16, size_t n);
+void _packString(jsonWriter_t *w, const char *str);
+void _packNode(json_t *value, jsonWriter_t *w);
+bool _packValue(json_t *value, jsonWriter_t *w);
+uint64_t _unpackUint(const uint8_t *p, int n);
+bool _unpackSax(const uint8_t **src, const uint8_t *end, const jsonSax_t *sax, void *ctx, int maxDepth);
+json_t *_unpackValue(const uint8_t *buf, size_t len, jsonArena_t *arena);
+
+bool _tapeGrow(char **buf, size_t *size, size_t len, size_t n);
+uint64_t _tapeAlloc(jsonTapeWriter_t *t, size_t n);
+uint64_t _tapeString(jsonTapeWriter_t *t, const char *str);
+bool _tapeFill(jsonTapeWriter_t *t, uint64_t rec, json_t *value, bool label);
+uint64_t _tapeSlots(const jsonTapeNode_t *node);
+bool _tapeLayout(jsonTapeWriter_t *t, json_t *root);
+const jsonTapeNode_t *_tapeTable(jsonTape_t *tape, const jsonTapeNode_t *node);
+const char *_tapeText(jsonTape_t *tape, uint64_t off);
+const jsonTapeNode_t *_tapeStep(jsonTape_t *tape, const jsonTapeNode_t *node, const jsonPathSeg_t *seg);
+json_t *_tapeNode(jsonTape_t *tape, const jsonTapeNode_t *rec);
+json_t *_tapeBuild(jsonTape_t *tape, const jsonTapeNode_t *rec);
 
 /************************************
  **  #internat# Utility Functions  **
@@ -85,856 +408,5763 @@ inline bool _jsonFillZero(json_t *dst)
     return true;
 }
 
-/*************************
- **  Filling Functions  **
- *************************/
-bool jsonSetNull(json_t *dst)
+/* keeps a short string or label in the node's text[], a label goes behind 
+ * an inline string, containers only have the bytes in front of their index; 
+ * returns NULL if it does not fit
+ */
+inline char *_inlineText(json_t *node, const char *str, size_t len, bool label)
 {
-    return _jsonFillZero(dst);  // equals to null
-}
+    size_t at=0, room=JSON_INLINE;
 
-bool jsonSetBoolean(json_t *dst, bool value)
-{
-    if(!_jsonFillZero(dst)) return false;
+    if(node->type==JSON_TYPE_ARRAY || node->type==JSON_TYPE_OBJECT) room=offsetof(json_t, index)-offsetof(json_t, text);
+    if(label && node->type==JSON_TYPE_STRING && node->string==node->text) at=node->stringLen+1;
+    if(at+len+1>room) return NULL;
 
-    dst->type=JSON_TYPE_BOOLEAN;
-    dst->boolean=value;
+    memmove(node->text+at, str, len);
+    node->text[at+len]='\0';
+    if(label) node->labelLen=len;
+    else node->stringLen=len;
 
-    return true;
+    return node->text+at;
 }
 
-bool jsonSetString(json_t *dst, const char *value)
+/* doubles an explicit stack which starts in 'local' on the C stack, 
+ * returns NULL (old stack untouched) if out of memory
+ */
+inline void *_stackGrow(void *stack, void *local, int *size, size_t elem)
 {
-    int len;
-
-    if(!value || !_jsonFillZero(dst)) return false;
+    void *rval;
 
-    len=strlen(value);
-    dst->string=malloc(len+1);
-    if(!dst->string) return false;
+    rval=jsonMemAlloc(*size*2*elem);
+    if(!rval) return NULL;
 
-    dst->type=JSON_TYPE_STRING;
-    strcpy(dst->string, value);
-    dst->string[len]='\0';
+    memcpy(rval, stack, *size*elem);
+    if(stack!=local) jsonMemFree(stack);
+    *size*=2;
 
-    return true;
+    return rval;
 }
 
-bool jsonRefString(json_t *dst, char *value)
+/***************************
+ **  Allocator Functions  **
+ ***************************/
+/* Every allocation of the library goes through jsonMemAlloc(), 
+ * jsonMemRealloc() and jsonMemFree(): to the allocator of the calling 
+ * thread if one is set, else to the global one (malloc() by default). With 
+ * stats set for the thread, live and peak bytes (as 'usable' tells) and 
+ * the number of allocations are counted there, and an allocation that 
+ * would take live past the limit fails with JSON_ERROR_MEMORY. Blocks must 
+ * be freed under the allocator that made them.
+ */
+void *_stdMalloc(void *ctx, size_t size)
 {
-    if(!value || !_jsonFillZero(dst)) return false;
+    (void)ctx;
+    return malloc(size);
+}
 
-    dst->type=JSON_TYPE_STRING;
-    dst->string=value;
-    dst->reference=true;
+void *_stdRealloc(void *ctx, void *ptr, size_t size)
+{
+    (void)ctx;
+    return realloc(ptr, size);
+}
 
-    return true;
+void _stdFree(void *ctx, void *ptr)
+{
+    (void)ctx;
+    free(ptr);
 }
 
-bool jsonSetInteger(json_t *dst, int64_t value)
+size_t _stdUsable(void *ctx, void *ptr)
 {
-    if(!_jsonFillZero(dst)) return false;
+    (void)ctx;
+    return malloc_usable_size(ptr);
+}
 
-    dst->type=JSON_TYPE_INTEGER;
-    dst->integer=value;
+jsonAllocator_t _jsonAllocator = { _stdMalloc, _stdRealloc, _stdFree, _stdUsable, NULL };
+__thread const jsonAllocator_t *_jsonThreadAllocator = NULL;
+__thread jsonAllocStats_t *_jsonStats = NULL;
 
-    return true;
+/* stats may be shared by threads (the JSON Lines workers), the limit is 
+ * checked before and the usable size counted after an allocation
+ */
+inline bool _statsRoom(jsonAllocStats_t *stats, size_t size)
+{
+    if(!stats || !stats->limit) return true;
+    if(__atomic_load_n(&stats->live, __ATOMIC_RELAXED)+(int64_t)size<=stats->limit) return true;
+
+    json_error=JSON_ERROR_MEMORY;
+    return false;
 }
 
-bool jsonSetNumeric(json_t *dst, double value)
+inline void _statsTake(jsonAllocStats_t *stats, size_t size)
 {
-    if(!_jsonFillZero(dst)) return false;
+    int64_t live, peak;
 
-    dst->type=JSON_TYPE_NUMERIC;
-    dst->numeric=value;
+    if(!stats) return;
 
-    return true;
+    __atomic_add_fetch(&stats->count, 1, __ATOMIC_RELAXED);
+    live=__atomic_add_fetch(&stats->live, (int64_t)size, __ATOMIC_RELAXED);
+    peak=__atomic_load_n(&stats->peak, __ATOMIC_RELAXED);
+    while(live>peak && !__atomic_compare_exchange_n(&stats->peak, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 }
 
-inline bool _jsonSetArray(json_t *dst, json_t *value, bool ref)
+inline void _statsGive(jsonAllocStats_t *stats, size_t size)
 {
-    if(!_jsonFillZero(dst)) return false;
-
-    dst->type=JSON_TYPE_ARRAY;
-    dst->list=value;
-    dst->reference=ref;
+    if(stats) __atomic_sub_fetch(&stats->live, (int64_t)size, __ATOMIC_RELAXED);
+}
 
-    return true;
+inline const jsonAllocator_t *_allocator(void)
+{
+    return _jsonThreadAllocator ? _jsonThreadAllocator : &_jsonAllocator;
 }
 
-bool jsonSetArray(json_t *dst, json_t *value)
+inline size_t _usable(const jsonAllocator_t *alloc, void *ptr)
 {
-    return _jsonSetArray(dst, value, false);
+    return alloc->usable ? alloc->usable(alloc->ctx, ptr) : 0;
 }
 
-bool jsonRefArray(json_t *dst, json_t *value)
+/* the allocator of all threads without one of their own (NULL for 
+ * malloc()), to be set before anything is allocated
+ */
+void jsonSetAllocator(const jsonAllocator_t *alloc)
 {
-    return _jsonSetArray(dst, value, true);
+    if(alloc) _jsonAllocator=*alloc;
+    else {
+        _jsonAllocator.malloc=_stdMalloc;
+        _jsonAllocator.realloc=_stdRealloc;
+        _jsonAllocator.free=_stdFree;
+        _jsonAllocator.usable=_stdUsable;
+        _jsonAllocator.ctx=NULL;
+    }
 }
 
-inline bool _jsonSetObject(json_t *dst, json_t *value, bool ref)
+/* the calling thread's allocator (NULL for the global one), returns the 
+ * previous one; trees built under it are freed with jsonFreeWith(), since 
+ * jsonFree() goes through the allocator in effect when it is called
+ */
+const jsonAllocator_t *jsonSetThreadAllocator(const jsonAllocator_t *alloc)
 {
-    if(!_jsonFillZero(dst)) return false;
+    const jsonAllocator_t *rval = _jsonThreadAllocator;
 
-    dst->type=JSON_TYPE_OBJECT;
-    dst->list=value;
-    dst->reference=ref;
+    _jsonThreadAllocator=alloc;
 
-    return true;
+    return rval;
 }
 
-bool jsonSetObject(json_t *dst, json_t *value)
+/* where the calling thread's allocations are counted (NULL for nowhere), 
+ * returns the previous stats
+ */
+jsonAllocStats_t *jsonSetAllocStats(jsonAllocStats_t *stats)
 {
-    return _jsonSetObject(dst, value, false);
+    jsonAllocStats_t *rval = _jsonStats;
+
+    _jsonStats=stats;
+
+    return rval;
 }
 
-bool jsonRefObject(json_t *dst, json_t *value)
+void *jsonMemAlloc(size_t size)
 {
-    return _jsonSetObject(dst, value, true);
+    const jsonAllocator_t *alloc = _allocator();
+    void *rval;
+
+    if(!_statsRoom(_jsonStats, size)) return NULL;
+
+    rval=alloc->malloc(alloc->ctx, size);
+    if(!rval) {
+        json_error=JSON_ERROR_MEMORY;
+        return NULL;
+    }
+    if(_jsonStats) _statsTake(_jsonStats, _usable(alloc, rval));
+
+    return rval;
 }
 
-bool jsonInsertList(json_t *dst, json_t *value)
+void *jsonMemRealloc(void *ptr, size_t size)
 {
-    json_t *ptr;
-
-    if(!dst || (dst->type!=JSON_TYPE_ARRAY && dst->type!=JSON_TYPE_OBJECT)) return false;
+    const jsonAllocator_t *alloc = _allocator();
+    size_t old = 0;
+    void *rval;
 
-    ptr=dst->list;
-    if(dst->list) {
-        ptr=dst->list;
-        while(ptr->next) ptr=ptr->next;
+    if(_jsonStats) {
+        if(ptr) old=_usable(alloc, ptr);
+        if(size>old && !_statsRoom(_jsonStats, size-old)) return NULL;
+    }
 
-        ptr->next=value;
+    rval=alloc->realloc(alloc->ctx, ptr, size);
+    if(!rval) {
+        json_error=JSON_ERROR_MEMORY;
+        return NULL;
+    }
+    if(_jsonStats) {
+        _statsGive(_jsonStats, old);
+        _statsTake(_jsonStats, _usable(alloc, rval));
     }
-    else dst->list=value;
+
+    return rval;
 }
 
-bool jsonLabelName(json_t *dst, const char *str)
+void jsonMemFree(void *ptr)
 {
-    if(!dst || !str) return false;
-    if(dst->label) free(dst->label);
+    const jsonAllocator_t *alloc = _allocator();
 
-    dst->label=malloc(strlen(str)+1);
-    strcpy(dst->label, str);
+    if(!ptr) return;
+
+    if(_jsonStats) _statsGive(_jsonStats, _usable(alloc, ptr));
+    alloc->free(alloc->ctx, ptr);
 }
 
-/*************************************
- **  #internal# Matching Functions  **
- *************************************/
-/* src := (char **) scanning pointer for whole input string, modify 
- *     while scanning/parsing in order to keep the progress
- * cptr := (char *) local temp pointer in each matching function
- */
-inline char *_skipWhitespace(char **src)
+inline void *_memZero(size_t count, size_t size)
 {
-    while(**src==' ' || **src=='\n' || **src=='\r' || **src=='\t') {
-        (*src)++;
-    }
+    void *rval;
 
-    return *src;
+    rval=jsonMemAlloc(count*size);
+    if(rval) memset(rval, 0, count*size);
+
+    return rval;
 }
 
-json_t *_matchNull(char **src)
+/* switches the calling thread to an allocator and stats of a context 
+ * (NULL ones keep the thread's), returns what to switch back to
+ */
+inline jsonAllocScope_t _scopeEnter(const jsonAllocator_t *alloc, jsonAllocStats_t *stats)
 {
-    json_t *rval;
-
-    if((*src)[0]!='n' && (*src)[0]!='N') return NULL;
-    if((*src)[1]!='u' && (*src)[1]!='U') return NULL;
-    if((*src)[2]!='l' && (*src)[2]!='L') return NULL;
-    if((*src)[3]!='l' && (*src)[3]!='L') return NULL;
-    if(isalnum((*src)[4])) return NULL;
+    jsonAllocScope_t rval = { _jsonThreadAllocator, _jsonStats };
 
-    (*src)+=4;
-    rval=malloc(sizeof(json_t));
-    jsonSetNull(rval);
+    if(alloc) _jsonThreadAllocator=alloc;
+    if(stats) _jsonStats=stats;
 
     return rval;
 }
 
-json_t *_matchBooleanTrue(char **src)
+inline void _scopeLeave(jsonAllocScope_t scope)
 {
-    json_t *rval;
+    _jsonThreadAllocator=scope.alloc;
+    _jsonStats=scope.stats;
+}
 
-    if((*src)[0]!='t' && (*src)[0]!='T') return NULL;
-    if((*src)[1]!='r' && (*src)[1]!='R') return NULL;
-    if((*src)[2]!='u' && (*src)[2]!='U') return NULL;
-    if((*src)[3]!='e' && (*src)[3]!='E') return NULL;
-    if(isalnum((*src)[4])) return NULL;
+/***********************
+ **  Arena Functions  **
+ ***********************/
+/* An arena hands out memory from large chunks by bumping a pointer. Nodes, 
+ * strings and labels of an arena-parsed document all live in its chunks, 
+ * so the whole document is released at once by jsonArenaReset() or 
+ * jsonArenaFree(). Such nodes are marked as 'fixed', jsonFree() skips them.
+ */
+typedef struct jsonChunk_t {
+    struct jsonChunk_t *next;
+    size_t size;  // usable bytes after this header
+} jsonChunk_t;
 
-    (*src)+=4;
-    rval=malloc(sizeof(json_t));
-    jsonSetBoolean(rval, true);
+jsonArena_t *jsonArenaNew(size_t chunkSize)
+{
+    jsonArena_t *arena;
 
-    return rval;
+    arena=jsonMemAlloc(sizeof(jsonArena_t));
+    if(!arena) return NULL;
+
+    memset(arena, 0, sizeof(jsonArena_t));
+    arena->chunkSize=chunkSize ? chunkSize : JSON_ARENA_CHUNK;
+
+    return arena;
 }
 
-json_t *_matchBooleanFalse(char **src)
+bool _jsonArenaGrow(jsonArena_t *arena, size_t size)
 {
-    json_t *rval;
+    jsonChunk_t *chunk;
 
-    if((*src)[0]!='f' && (*src)[0]!='F') return NULL;
-    if((*src)[1]!='a' && (*src)[1]!='A') return NULL;
-    if((*src)[2]!='l' && (*src)[2]!='L') return NULL;
-    if((*src)[3]!='s' && (*src)[3]!='S') return NULL;
-    if((*src)[4]!='e' && (*src)[4]!='E') return NULL;
-    if(isalnum((*src)[5])) return NULL;
+    if(size<arena->chunkSize) size=arena->chunkSize;
 
-    (*src)+=5;
-    rval=malloc(sizeof(json_t));
-    jsonSetBoolean(rval, false);
+    chunk=jsonMemAlloc(sizeof(jsonChunk_t)+size);
+    if(!chunk) return false;
 
-    return rval;
+    chunk->size=size;
+    chunk->next=arena->chunk;
+    arena->chunk=chunk;
+    arena->ptr=(char *)(chunk+1);
+    arena->end=arena->ptr+size;
+
+    return true;
 }
 
-inline int _getString(char **src, char *buf)
+void *jsonArenaAlloc(jsonArena_t *arena, size_t size)
 {
-    int pLen = 0;
+    jsonChunk_t *chunk;
+    void *rval;
 
-    if(**src!='\"') return 0;
-    (*src)++;
+    if(!arena) return NULL;
 
-    // scan to the end double quote or string end   
-    while(**src!='\"' && **src!='\0') {
-        if(**src=='\\') { // escape character
-            (*src)++; // (the escape character)
-            switch(**src) { // look ahead                    
-                case '\"':
-                    buf[pLen++]='\"';
-                    break;
-                case '\\':
-                    buf[pLen++]='\\';
-                    break;
-                case '/':
-                    buf[pLen++]='/';
-                    break;
-                case 'n':
-                    buf[pLen++]='\n';
-                    break;
-                case 'r':
-                    buf[pLen++]='\r';
-                    break;
-                case 't':
-                    buf[pLen++]='\t';
-                    break;
-                case 'b':
-                case 'f':
-                case 'u':
-                    // transparent
-                    buf[pLen++]='\\';
-                    buf[pLen++]='u'; 
-                    break;
-                default: // including '\0'
-                    // syntax error
-                    return 0;
-            }
+    size=(size+7)&~(size_t)7; // keep 8-byte alignment for nodes
 
-            (*src)++; // (the one after escape character)
-        }
-        else {
-            buf[pLen++]=**src;
-            (*src)++;
+    if(size>(size_t)(arena->end-arena->ptr)) {
+        if(arena->chunk && size>arena->chunkSize/2) {
+            // large block: give it a chunk of its own behind the current one, 
+            // so the space left in the current chunk is not wasted
+            chunk=jsonMemAlloc(sizeof(jsonChunk_t)+size);
+            if(!chunk) return NULL;
+
+            chunk->size=size;
+            chunk->next=arena->chunk->next;
+            arena->chunk->next=chunk;
+
+            return chunk+1;
         }
+
+        if(!_jsonArenaGrow(arena, size)) return NULL;
     }
-    
-    // syntax error, should end with a double quote
-    if(**src=='\0') return 0; 
-    else (*src)++; // shift the '\"'
 
-    buf[pLen]='\0';
+    rval=arena->ptr;
+    arena->ptr+=size;
 
-    return pLen;
+    return rval;
 }
 
-json_t *_matchString(char **src)
+void jsonArenaReset(jsonArena_t *arena)
 {
-    json_t *rval;
-    char buf[2048];
+    jsonChunk_t *chunk, *next;
 
-    if(!_getString(src, buf)) {
-        // syntax error
-        return NULL;
-    }
+    if(!arena || !arena->chunk) return;
 
-    rval=malloc(sizeof(json_t));
-    if(!jsonSetString(rval, buf)) {
-        // error
-        return NULL;
+    // keep the current chunk for reuse, release the others
+    for(chunk=arena->chunk->next; chunk!=NULL; chunk=next) {
+        next=chunk->next;
+        jsonMemFree(chunk);
     }
 
-    return rval;
+    chunk=arena->chunk;
+    chunk->next=NULL;
+    arena->ptr=(char *)(chunk+1);
+    arena->end=arena->ptr+chunk->size;
 }
 
-json_t *_matchNumber(char **src)
+/* jsonArenaReset() for an arena used over and over: if the last round 
+ * took several chunks, they are replaced by one of their total size, so 
+ * the arena settles on a single chunk and stops allocating
+ */
+inline void _jsonArenaRecycle(jsonArena_t *arena)
 {
-    json_t *rval;
-    char buf[2048];
-    bool numeric = false;
-    int i = 0;
+    jsonChunk_t *chunk, *next;
+    size_t total;
 
-    if(**src=='-') {
-        buf[i++]='-';
-        (*src)++;
+    if(!arena || !arena->chunk) return;
+    if(!arena->chunk->next) {
+        jsonArenaReset(arena);
+        return;
     }
 
-    while(isdigit(**src)) {
-        buf[i++]=**src;
-        (*src)++;
+    total=0;
+    for(chunk=arena->chunk; chunk!=NULL; chunk=next) {
+        next=chunk->next;
+        total+=chunk->size;
+        jsonMemFree(chunk);
     }
 
-    if(**src=='.') {
-        buf[i++]='.';
-        numeric=true;
-        (*src)++;
-    }
+    arena->chunk=NULL;
+    arena->ptr=NULL;
+    arena->end=NULL;
+    arena->chunkSize=total;
+}
 
-    while(isdigit(**src)) {
-        buf[i++]=**src;
-        (*src)++;
-    }
+void jsonArenaFree(jsonArena_t *arena)
+{
+    jsonChunk_t *chunk, *next;
 
-    if(**src=='e' || **src=='E') {
-        buf[i++]='e';
-        numeric=true;
-        (*src)++;
-    }
+    if(!arena) return;
 
-    if(**src=='-' || **src=='+') {
-        buf[i++]=**src;
-        (*src)++;
+    for(chunk=arena->chunk; chunk!=NULL; chunk=next) {
+        next=chunk->next;
+        jsonMemFree(chunk);
     }
 
-    while(isdigit(**src)) {
-        buf[i++]=**src;
-        (*src)++;
-    }
+    jsonMemFree(arena);
+}
 
-    buf[i]='\0';
+inline json_t *_newNode(jsonArena_t *arena)
+{
+    if(arena) return jsonArenaAlloc(arena, sizeof(json_t));
+    else return jsonPoolAlloc(sizeof(json_t));
+}
+
+/**********************
+ **  Pool Functions  **
+ **********************/
+/* Heap nodes (and other small fixed-size records) come from per-thread free 
+ * lists by size class. A cache that grows past two batches hands one batch 
+ * to the class's depot, a list of batches guarded by _jsonPoolLock, and an 
+ * empty cache takes a batch from there before it allocates, so blocks freed 
+ * on one thread are reused on the others; a batch the full depot can not 
+ * take is freed. Every block is an ordinary block of the global allocator 
+ * of its class size: jsonMemFree() and jsonPoolFree() may be mixed, e.g. a 
+ * node malloc()ed by the application still goes through jsonFree().
+ */
+jsonPoolBlock_t *_jsonPoolDepot[JSON_POOL_CLASSES];
+int _jsonPoolBatches[JSON_POOL_CLASSES];
+pthread_mutex_t _jsonPoolLock = PTHREAD_MUTEX_INITIALIZER;
+__thread jsonPoolCache_t _jsonPoolCache[JSON_POOL_CLASSES];
+__thread bool _jsonPoolKeyed = false;
+pthread_key_t _jsonPoolKey;
+pthread_once_t _jsonPoolOnce = PTHREAD_ONCE_INIT;
+
+inline int _poolClass(size_t size)
+{
+    if(size<JSON_POOL_MIN || size>JSON_POOL_MIN+(JSON_POOL_CLASSES-1)*8) return -1;
+
+    return (size-JSON_POOL_MIN+7)/8;
+}
 
-    rval=malloc(sizeof(json_t));
-    if(numeric) jsonSetNumeric(rval, strtod(buf, NULL));
-    else jsonSetInteger(rval, strtoll(buf, NULL, 10));
+/* false when the depot is full and the batch stays with the caller */
+inline bool _poolPush(int c, jsonPoolBlock_t *batch)
+{
+    bool rval = false;
+
+    pthread_mutex_lock(&_jsonPoolLock);
+    if(_jsonPoolBatches[c]<JSON_POOL_DEPOT) {
+        batch->batch=_jsonPoolDepot[c];
+        _jsonPoolDepot[c]=batch;
+        _jsonPoolBatches[c]++;
+        rval=true;
+    }
+    pthread_mutex_unlock(&_jsonPoolLock);
 
     return rval;
 }
 
-json_t *_matchArray(char **src)
+inline jsonPoolBlock_t *_poolPop(int c)
 {
-    json_t *rval;
-    json_t *arrayHead, *arrayTail, *matchedItem;
+    jsonPoolBlock_t *head;
 
-    if(**src!='[') return NULL;
-    (*src)++;
+    pthread_mutex_lock(&_jsonPoolLock);
+    head=_jsonPoolDepot[c];
+    if(head) {
+        _jsonPoolDepot[c]=head->batch;
+        _jsonPoolBatches[c]--;
+    }
+    pthread_mutex_unlock(&_jsonPoolLock);
 
-    arrayHead=NULL;
-    while(1) {
-        _skipWhitespace(src);
+    return head;
+}
 
-        matchedItem=_buildValue(src);
-        if(matchedItem) {
-            if(arrayHead==NULL) {
-                arrayHead=matchedItem;
-                arrayTail=arrayHead;
-            }
-            else {
-                arrayTail->next=matchedItem;
-                arrayTail=arrayTail->next;
-            }
+/* an exiting thread gives its cached blocks back to the system */
+void _poolRelease(void *cache)
+{
+    jsonPoolCache_t *pc = cache;
+    jsonPoolBlock_t *block, *next;
+    int c;
+
+    for(c=0; c<JSON_POOL_CLASSES; c++) {
+        for(block=pc[c].head; block; block=next) {
+            next=block->next;
+            _jsonAllocator.free(_jsonAllocator.ctx, block);
         }
-        else break; // syntax error
+        pc[c].head=NULL;
+        pc[c].count=0;
+    }
+}
 
-        _skipWhitespace(src);
+void _poolKey(void)
+{
+    pthread_key_create(&_jsonPoolKey, _poolRelease);
+}
 
-        if(**src==',') (*src)++;
-        else break;
+inline jsonPoolCache_t *_poolCache(void)
+{
+    if(!_jsonPoolKeyed) {
+        pthread_once(&_jsonPoolOnce, _poolKey);
+        pthread_setspecific(_jsonPoolKey, _jsonPoolCache);
+        _jsonPoolKeyed=true;
     }
 
-    if(**src!=']') {
-        // syntax error
-        return NULL;
+    return _jsonPoolCache;
+}
+
+/* with a thread allocator set, blocks go to and from it directly */
+void *jsonPoolAlloc(size_t size)
+{
+    jsonPoolCache_t *pc;
+    jsonPoolBlock_t *block;
+    int c;
+
+    c=_poolClass(size);
+    if(c<0 || _jsonThreadAllocator) return jsonMemAlloc(size);
+    if(!_statsRoom(_jsonStats, size)) return NULL;
+
+    pc=&_poolCache()[c];
+    if(!pc->head) {
+        pc->head=_poolPop(c);
+        pc->count=JSON_POOL_BATCH;
     }
-    else (*src)++;
 
-    rval=malloc(sizeof(json_t));
-    jsonSetArray(rval, arrayHead);
+    if(pc->head) {
+        block=pc->head;
+        pc->head=block->next;
+        pc->count--;
+    }
+    else {
+        block=_jsonAllocator.malloc(_jsonAllocator.ctx, JSON_POOL_MIN+c*8);
+        pc->count=0;
+        if(!block) {
+            json_error=JSON_ERROR_MEMORY;
+            return NULL;
+        }
+    }
+    // counted like jsonMemAlloc() does, either may free the block
+    if(_jsonStats) _statsTake(_jsonStats, _usable(&_jsonAllocator, block));
 
-    return rval;
+    return block;
 }
 
-json_t *_matchObject(char **src)
+/* 'size' is the one asked from jsonPoolAlloc() (or jsonMemAlloc()) */
+void jsonPoolFree(void *ptr, size_t size)
 {
-    json_t *rval;
-    json_t *objectHead, *objectTail, *matchedItem;
-    char buf[2048];
-    int len;
+    jsonPoolCache_t *pc;
+    jsonPoolBlock_t *block = ptr, *tail;
+    int c, n;
 
-    if(**src!='{') return NULL;
-    (*src)++;
+    if(!ptr) return;
 
-    objectHead=NULL;
-    while(1) {
-        _skipWhitespace(src);
+    c=_poolClass(size);
+    if(c<0 || (size&7) || _jsonThreadAllocator) {  // a block of another size
+        jsonMemFree(ptr);
+        return;
+    }
+    if(_jsonStats) _statsGive(_jsonStats, _usable(&_jsonAllocator, ptr));
 
-        if(!_getString(src, buf)) {
-            // syntax error
-            return NULL;
-        }
+    pc=&_poolCache()[c];
+    block->next=pc->head;
+    pc->head=block;
+    pc->count++;
+    if(pc->count<2*JSON_POOL_BATCH) return;
 
-        _skipWhitespace(src);
+    // the newest batch stays, the one behind it goes
+    for(tail=pc->head, n=1; n<JSON_POOL_BATCH; n++) tail=tail->next;
+    block=tail->next;
+    tail->next=NULL;
+    pc->count=JSON_POOL_BATCH;
 
-        if(**src!=':') {
-            // syntax error
-            return NULL;
-        }
-        else (*src)++; // shift the ':'
+    if(_poolPush(c, block)) return;
 
-        _skipWhitespace(src);
+    for(; block; block=tail) {
+        tail=block->next;
+        _jsonAllocator.free(_jsonAllocator.ctx, block);
+    }
+}
+
+/* frees the blocks cached by the calling thread and those in the depots, 
+ * for leak checkers at exit; no other thread may use the pool meanwhile
+ */
+void jsonPoolTrim(void)
+{
+    jsonPoolBlock_t *batch, *block, *next;
+    int c;
 
-        matchedItem=_buildValue(src);
-        if(matchedItem) {
-            len=strlen(buf);
-            matchedItem->label=malloc(len+1);
-            strcpy(matchedItem->label, buf);
-            matchedItem->label[len]='\0';
+    _poolRelease(_poolCache());
 
-            if(objectHead==NULL) {
-                objectHead=matchedItem;
-                objectTail=objectHead;
-            }
-            else {
-                objectTail->next=matchedItem;
-                objectTail=matchedItem;
+    for(c=0; c<JSON_POOL_CLASSES; c++) {
+        while((batch=_poolPop(c))) {
+            for(block=batch; block; block=next) {
+                next=block->next;
+                _jsonAllocator.free(_jsonAllocator.ctx, block);
             }
         }
-        else break; // syntax error
+    }
+}
 
-        _skipWhitespace(src);
+/*************************************
+ **  #internal# Index Functions     **
+ *************************************/
+/* Large arrays and objects get a side index: the members in list order 
+ * (for positional access and counting) and, for objects, an open-addressing 
+ * hash table from label to member. It is made when a list of more than 
+ * JSON_INDEX_MIN members is parsed or copied, or grown that large by 
+ * jsonInsertList(), never by a lookup, so a tree can be queried from 
+ * several threads at once. The list through next stays the primary 
+ * storage, so order is kept. Members of an indexed object are filed under 
+ * their label and best renamed through jsonLabelMember(); jsonLabelName() 
+ * can not reach the index of a member, it counts the rename instead and 
+ * each object index checks its labels once per count. A fixed list keeps 
+ * its arena where the index would be until it has one, and its index is 
+ * made (and regrown) in that arena, so jsonArenaReset() releases it too.
+ */
+typedef struct jsonSlot_t {
+    uint32_t hash;
+    uint32_t pos;    // of the member in item[]
+    json_t *member;  // NULL: empty slot
+} jsonSlot_t;
+
+typedef struct jsonIndex_t {
+    uint32_t count;      // members in the list
+    uint32_t capacity;   // room in item[], slot[] has twice as much
+    uint32_t renames;    // _jsonRenames when the labels last matched
+    bool stale;          // a label no longer matches, rebuilt on change
+    jsonArena_t *arena;  // of a fixed list, NULL on the heap
+    json_t **item;       // members in list order
+    jsonSlot_t *slot;    // objects only
+} jsonIndex_t;
+
+/* FNV-1a */
+inline uint32_t _jsonHash(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
 
-        if(**src==',') (*src)++;
-        else break;
+    for(i=0; i<len; i++) {
+        hash^=(uint8_t)str[i];
+        hash*=16777619u;
     }
 
-    if(**src!='}') {
-        // syntax error
+    return hash;
+}
+
+/* renames of indexed members through jsonLabelName() */
+uint32_t _jsonRenames = 0;
+
+inline uint32_t _labelHash(json_t *member)
+{
+    if(member->interned) return _keyOf(member->label)->hash;
+
+    return _jsonHash(member->label, strlen(member->label));
+}
+
+/* files an object member in the hash table under its label, 'pos' is its 
+ * place in item[]
+ */
+inline void _indexFile(jsonIndex_t *index, json_t *member, uint32_t pos)
+{
+    uint32_t hash, i, mask;
+
+    member->indexed=true;
+    if(!member->label) return;
+
+    mask=index->capacity*2-1;
+    hash=_labelHash(member);
+    for(i=hash&mask; index->slot[i].member; i=(i+1)&mask) {
+        // duplicated label, the first one wins (as in a linear search)
+        if(index->slot[i].hash==hash && strcmp(index->slot[i].member->label, member->label)==0) return;
+    }
+
+    index->slot[i].hash=hash;
+    index->slot[i].pos=pos;
+    index->slot[i].member=member;
+}
+
+inline void _indexInsert(jsonIndex_t *index, json_t *member)
+{
+    index->item[index->count]=member;
+    if(index->slot) _indexFile(index, member, index->count);
+    index->count++;
+}
+
+/* files all members again, after one was renamed or removed */
+void _indexRehash(jsonIndex_t *index)
+{
+    uint32_t i;
+
+    index->renames=__atomic_load_n(&_jsonRenames, __ATOMIC_ACQUIRE);
+    index->stale=false;
+    memset(index->slot, 0, index->capacity*2*sizeof(jsonSlot_t));
+    for(i=0; i<index->count; i++) _indexFile(index, index->item[i], i);
+}
+
+inline jsonSlot_t *_indexSlot(jsonIndex_t *index, const char *key, uint32_t hash)
+{
+    uint32_t i, mask;
+
+    mask=index->capacity*2-1;
+    for(i=hash&mask; index->slot[i].member; i=(i+1)&mask) {
+        if(index->slot[i].hash==hash && strcmp(index->slot[i].member->label, key)==0) return &index->slot[i];
+    }
+
+    return NULL;
+}
+
+inline json_t *_indexLookup(jsonIndex_t *index, const char *key, uint32_t hash)
+{
+    jsonSlot_t *slot;
+
+    slot=_indexSlot(index, key, hash);
+    return slot ? slot->member : NULL;
+}
+
+/* whether the hash table of an object still finds every member by its 
+ * label the way a linear search would, after renames through 
+ * jsonLabelName(); lookups run concurrently, so the outcome is only ever 
+ * stored atomically, and a stale index is left for the next change of the 
+ * list to rebuild
+ */
+bool _indexCurrent(jsonIndex_t *index)
+{
+    jsonSlot_t *slot;
+    json_t *member;
+    uint32_t renames, i;
+
+    renames=__atomic_load_n(&_jsonRenames, __ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&index->stale, __ATOMIC_RELAXED)) return false;
+    if(__atomic_load_n(&index->renames, __ATOMIC_RELAXED)==renames) return true;
+
+    for(i=0; i<index->capacity*2; i++) {
+        member=index->slot[i].member;
+        if(member && (!member->label || _labelHash(member)!=index->slot[i].hash)) goto stale;
+    }
+    for(i=0; i<index->count; i++) {
+        member=index->item[i];
+        if(!member->label) continue;
+        slot=_indexSlot(index, member->label, _labelHash(member));
+        if(!slot || slot->pos>i) goto stale;  // missed, or not the first one
+    }
+
+    __atomic_store_n(&index->renames, renames, __ATOMIC_RELAXED);
+    return true;
+
+stale:
+    __atomic_store_n(&index->stale, true, __ATOMIC_RELAXED);
+    return false;
+}
+
+/* the arena a fixed list lives in */
+inline jsonArena_t *_listArena(json_t *list)
+{
+    if(list->arenaRef) return list->arena;
+
+    return list->index ? list->index->arena : NULL;
+}
+
+/* keeps the arena of a fixed list for the index it may get */
+inline void _listSetArena(json_t *list, jsonArena_t *arena)
+{
+    list->arena=arena;
+    list->arenaRef=(arena!=NULL);
+}
+
+/* (re)builds the index of an array or object, in the arena of a fixed one */
+jsonIndex_t *_indexBuild(json_t *list)
+{
+    jsonIndex_t *index;
+    jsonArena_t *arena = NULL;
+    json_t *ptr;
+    uint32_t count, capacity;
+    size_t size;
+
+    if(list->fixed) {
+        arena=_listArena(list);
+        if(!arena) return NULL;
+    }
+
+    count=0;
+    for(ptr=list->list; ptr!=NULL; ptr=ptr->next) count++;
+
+    for(capacity=16; capacity<=count; capacity<<=1);
+
+    size=sizeof(jsonIndex_t)+capacity*sizeof(json_t *);
+    if(list->type==JSON_TYPE_OBJECT) size+=capacity*2*sizeof(jsonSlot_t);
+
+    if(arena) index=jsonArenaAlloc(arena, size);
+    else index=jsonMemAlloc(size);
+    if(!index) return NULL;
+
+    memset(index, 0, size);
+    index->capacity=capacity;
+    index->renames=__atomic_load_n(&_jsonRenames, __ATOMIC_ACQUIRE);
+    index->arena=arena;
+    index->item=(json_t **)(index+1);
+    if(list->type==JSON_TYPE_OBJECT) index->slot=(jsonSlot_t *)(index->item+capacity);
+
+    for(ptr=list->list; ptr!=NULL; ptr=ptr->next) _indexInsert(index, ptr);
+
+    if(!list->fixed && list->index) jsonMemFree(list->index);
+    list->index=index;
+    list->arenaRef=false;
+
+    return index;
+}
+
+/* the index of an array or object if it still matches the list, NULL to 
+ * walk the list; members are meant to come and go through jsonInsertList() 
+ * and jsonRemoveList(), links edited by hand are caught at the ends
+ */
+inline jsonIndex_t *_indexOf(json_t *list)
+{
+    jsonIndex_t *index = list->index;
+    uint32_t n;
+
+    if(list->arenaRef || !index) return NULL;
+
+    n=index->count;
+    if(list->list!=index->item[0]) return NULL;
+    if(index->item[n-2]->next!=index->item[n-1] || index->item[n-1]->next) return NULL;
+    if(index->slot && !_indexCurrent(index)) return NULL;
+
+    return index;
+}
+
+/* the list goes on without an index, its members are no longer filed */
+void _indexDrop(json_t *list)
+{
+    json_t *ptr;
+
+    if(list->arenaRef || !list->index) return;
+
+    if(list->type==JSON_TYPE_OBJECT) {
+        for(ptr=list->list; ptr!=NULL; ptr=ptr->next) ptr->indexed=false;
+    }
+    if(list->fixed) _listSetArena(list, list->index->arena);
+    else {
+        jsonMemFree(list->index);
+        list->index=NULL;
+    }
+}
+
+/* the index of a list about to be changed, rebuilt if it went stale */
+jsonIndex_t *_indexFix(json_t *list)
+{
+    json_t *ptr;
+    int n;
+
+    if(list->arenaRef || !list->index || _indexOf(list)) return _indexOf(list);
+
+    _indexDrop(list);
+    for(ptr=list->list, n=0; ptr && n<=JSON_INDEX_MIN; ptr=ptr->next) n++;
+    if(n>JSON_INDEX_MIN) return _indexBuild(list);
+
+    return NULL;
+}
+
+/* keeps the index in step with members appended to a list */
+void _indexAppend(json_t *list, json_t *member)
+{
+    jsonIndex_t *index = list->index;
+
+    if(list->arenaRef || !index) return;
+
+    for(; member!=NULL; member=member->next) {
+        if(index->count<index->capacity) {
+            _indexInsert(index, member);
+            continue;
+        }
+
+        // full, a twice larger one takes the whole list
+        _indexBuild(list);
+        return;
+    }
+}
+
+/* member of an object by label, 'hash' is _jsonHash() of 'key' */
+json_t *_objectMember(json_t *object, const char *key, uint32_t hash)
+{
+    jsonIndex_t *index;
+    json_t *ptr;
+
+    index=_indexOf(object);
+    if(index) return _indexLookup(index, key, hash);
+
+    for(ptr=object->list; ptr!=NULL; ptr=ptr->next) {
+        if(_labelIs(ptr, key, hash)) return ptr;
+    }
+
+    return NULL;
+}
+
+/* n-th member of an array */
+json_t *_arrayMember(json_t *array, int n)
+{
+    jsonIndex_t *index;
+    json_t *ptr;
+
+    index=_indexOf(array);
+    if(index && n>=0) return (n<(int)index->count)?index->item[n]:NULL;
+
+    for(ptr=array->list; n>0 && ptr; n--) ptr=ptr->next;
+
+    return ptr;
+}
+
+/*******************************
+ **  Key Interning Functions  **
+ *******************************/
+
+/* labels parsed with a jsonKeys_t are stored once per distinct text with 
+ * their hash in front, members refer to them (refLabel and interned set), 
+ * so the table must outlive every tree parsed with it
+ */
+inline jsonKey_t *_keyOf(const char *label)
+{
+    return (jsonKey_t *)(label-offsetof(jsonKey_t, str));
+}
+
+inline bool _labelIs(json_t *member, const char *key, uint32_t hash)
+{
+    if(!member->label) return false;
+    if(member->interned && _keyOf(member->label)->hash!=hash) return false;  // most misses end here
+
+    return strcmp(member->label, key)==0;
+}
+
+/* 'shared' tables may be used by several threads at once */
+jsonKeys_t *jsonKeysNew(bool shared)
+{
+    jsonKeys_t *keys;
+
+    keys=jsonMemAlloc(sizeof(jsonKeys_t));
+    if(!keys) return NULL;
+    memset(keys, 0, sizeof(jsonKeys_t));
+
+    keys->size=256;
+    keys->slot=_memZero(keys->size, sizeof(jsonKey_t *));
+    keys->arena=jsonArenaNew(0);
+    if(!keys->slot || !keys->arena) {
+        jsonMemFree(keys->slot);
+        jsonArenaFree(keys->arena);
+        jsonMemFree(keys);
         return NULL;
     }
-    else (*src)++;
 
-    rval=malloc(sizeof(json_t));
-    jsonSetObject(rval, objectHead);
+    keys->shared=shared;
+    if(shared) pthread_mutex_init(&keys->lock, NULL);
 
-    return rval;
+    return keys;
 }
 
-inline json_t *_buildValue(char **src)
+void jsonKeysFree(jsonKeys_t *keys)
 {
-    switch(**src) {
-        case '\"':
-            return _matchString(src);
-        case '-':
-        case '0':
-        case '1':
-        case '2':
-        case '3':
-        case '4':
-        case '5':
-        case '6':
-        case '7':
-        case '8':
-        case '9':
-            return _matchNumber(src);
-        case 'F':
-            return _matchBooleanFalse(src); 
-        case 'N':
-            return _matchNull(src);
-        case 'T':
-            return _matchBooleanTrue(src);
-        case '[':
-            return _matchArray(src);
-        case 'f':
-            return _matchBooleanFalse(src); 
-        case 'n':
-            return _matchNull(src);
-        case 't':
-            return _matchBooleanTrue(src);
-        case '{':
-            return _matchObject(src);
-        default:
-            // phrase error
-            return NULL;
+    if(!keys) return;
+
+    if(keys->shared) pthread_mutex_destroy(&keys->lock);
+    jsonArenaFree(keys->arena);
+    jsonMemFree(keys->slot);
+    jsonMemFree(keys);
+}
+
+/* distinct labels in the table */
+size_t jsonKeysCount(jsonKeys_t *keys)
+{
+    return keys ? keys->count : 0;
+}
+
+char *_keysIntern(jsonKeys_t *keys, const char *str, size_t len)
+{
+    jsonKey_t **slot, *key;
+    uint32_t hash;
+    size_t i, j, mask;
+
+    hash=_jsonHash(str, len);
+    if(keys->shared) pthread_mutex_lock(&keys->lock);
+
+    mask=keys->size-1;
+    for(i=hash&mask; (key=keys->slot[i])!=NULL; i=(i+1)&mask) {
+        if(key->hash==hash && key->len==len && memcmp(key->str, str, len)==0) goto done;
+    }
+
+    key=jsonArenaAlloc(keys->arena, sizeof(jsonKey_t)+len+1);
+    if(!key) goto done;
+    key->hash=hash;
+    key->len=len;
+    memcpy(key->str, str, len);
+    key->str[len]='\0';
+
+    keys->slot[i]=key;
+    keys->count++;
+
+    if(keys->count*2>keys->size) {  // rehash at half load
+        slot=_memZero(keys->size*2, sizeof(jsonKey_t *));
+        if(slot) {
+            mask=keys->size*2-1;
+            for(i=0; i<keys->size; i++) {
+                if(!keys->slot[i]) continue;
+                for(j=keys->slot[i]->hash&mask; slot[j]; j=(j+1)&mask);
+                slot[j]=keys->slot[i];
+            }
+            jsonMemFree(keys->slot);
+            keys->slot=slot;
+            keys->size*=2;
+        }
     }
+
+done:
+    if(keys->shared) pthread_mutex_unlock(&keys->lock);
+
+    return key ? key->str : NULL;
+}
+
+/* interned version of a label text, NULL if out of memory */
+const char *jsonKeysIntern(jsonKeys_t *keys, const char *str)
+{
+    if(!keys || !str) return NULL;
+
+    return _keysIntern(keys, str, strlen(str));
 }
 
 /*************************
- **  Utility Functions  **
+ **  Filling Functions  **
  *************************/
+bool jsonSetNull(json_t *dst)
+{
+    return _jsonFillZero(dst);  // equals to null
+}
 
-json_t *jsonParse(char *str)
+bool jsonSetBoolean(json_t *dst, bool value)
 {
-    _skipWhitespace(&str);
-    return _buildValue(&str);
+    if(!_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_BOOLEAN;
+    dst->boolean=value;
+
+    return true;
 }
 
-inline json_t *_queryArray(json_t *value, char **src)
+bool jsonSetString(json_t *dst, const char *value)
 {
-    json_t *accessPtr;
-    char buf[32];
-    int i, n;
+    int len;
 
-    if(**src!='[') return NULL;  // syntax error
-    else (*src)++;
+    if(!value || !_jsonFillZero(dst)) return false;
 
-    i=0;
-    while(isdigit(**src)) {
-        buf[i++]=**src;
-        (*src)++;
+    len=strlen(value);
+    dst->type=JSON_TYPE_STRING;
+    if((dst->string=_inlineText(dst, value, len, false))) {
+        dst->reference=true;    // kept in the node itself
+        return true;
     }
 
-    if(**src!=']') return NULL;  // syntax error
-    (*src)++;
-    buf[i]='\0';
+    dst->string=jsonMemAlloc(len+1);
+    if(!dst->string) {
+        dst->type=JSON_TYPE_NULL;
+        return false;
+    }
+
+    strcpy(dst->string, value);
+    dst->string[len]='\0';
+
+    return true;
+}
+
+bool jsonRefString(json_t *dst, char *value)
+{
+    if(!value || !_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_STRING;
+    dst->string=value;
+    dst->reference=true;
+
+    return true;
+}
+
+bool jsonSetInteger(json_t *dst, int64_t value)
+{
+    if(!_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_INTEGER;
+    dst->integer=value;
+
+    return true;
+}
+
+bool jsonSetNumeric(json_t *dst, double value)
+{
+    if(!_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_NUMERIC;
+    dst->numeric=value;
+
+    return true;
+}
+
+inline bool _jsonSetArray(json_t *dst, json_t *value, bool ref)
+{
+    if(!_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_ARRAY;
+    dst->list=value;
+    dst->reference=ref;
+
+    return true;
+}
+
+bool jsonSetArray(json_t *dst, json_t *value)
+{
+    return _jsonSetArray(dst, value, false);
+}
+
+bool jsonRefArray(json_t *dst, json_t *value)
+{
+    return _jsonSetArray(dst, value, true);
+}
+
+inline bool _jsonSetObject(json_t *dst, json_t *value, bool ref)
+{
+    if(!_jsonFillZero(dst)) return false;
+
+    dst->type=JSON_TYPE_OBJECT;
+    dst->list=value;
+    dst->reference=ref;
+
+    return true;
+}
+
+bool jsonSetObject(json_t *dst, json_t *value)
+{
+    return _jsonSetObject(dst, value, false);
+}
+
+bool jsonRefObject(json_t *dst, json_t *value)
+{
+    return _jsonSetObject(dst, value, true);
+}
+
+/* appends 'value' and the members chained behind it through next */
+bool jsonInsertList(json_t *dst, json_t *value)
+{
+    jsonIndex_t *index;
+    json_t *ptr;
+    int n;
+
+    if(!dst || (dst->type!=JSON_TYPE_ARRAY && dst->type!=JSON_TYPE_OBJECT)) return false;
+
+    index=_indexFix(dst);
+    if(index) {
+        index->item[index->count-1]->next=value;
+        _indexAppend(dst, value);
+        return true;
+    }
+
+    n=0;
+    if(!dst->list) dst->list=value;
+    else {
+        for(ptr=dst->list, n=1; ptr->next; n++) ptr=ptr->next;
+        ptr->next=value;
+    }
+
+    // a list grown this large keeps track of its tail from now on
+    for(ptr=value; ptr && n<=JSON_INDEX_MIN; ptr=ptr->next) n++;
+    if(n>JSON_INDEX_MIN) _indexBuild(dst);
+
+    return true;
+}
+
+/* moves all members of 'src' behind those of 'dst', 'src' is left empty */
+bool jsonSpliceList(json_t *dst, json_t *src)
+{
+    json_t *head;
+
+    if(!dst || !src || dst==src) return false;
+    if(src->type!=JSON_TYPE_ARRAY && src->type!=JSON_TYPE_OBJECT) return false;
+    if(dst->type!=JSON_TYPE_ARRAY && dst->type!=JSON_TYPE_OBJECT) return false;
+
+    head=src->list;
+    _indexDrop(src);
+    src->list=NULL;
+
+    return jsonInsertList(dst, head);
+}
+
+/* unlinks 'value' from the members of 'dst' without freeing it, false if 
+ * it is not one of them
+ */
+bool jsonRemoveList(json_t *dst, json_t *value)
+{
+    jsonIndex_t *index;
+    json_t *ptr, *prev;
+    uint32_t i;
+
+    if(!dst || !value || (dst->type!=JSON_TYPE_ARRAY && dst->type!=JSON_TYPE_OBJECT)) return false;
+
+    index=_indexFix(dst);
+    if(index) {
+        for(i=0; i<index->count && index->item[i]!=value; i++);
+        if(i==index->count) return false;
+        prev=(i>0)?index->item[i-1]:NULL;
+    }
+    else {
+        for(prev=NULL, ptr=dst->list; ptr && ptr!=value; ptr=ptr->next) prev=ptr;
+        if(!ptr) return false;
+    }
+
+    if(prev) prev->next=value->next;
+    else dst->list=value->next;
+    value->next=NULL;
+    value->indexed=false;
+
+    if(!index) return true;
+
+    if(index->count-1<=JSON_INDEX_MIN) _indexDrop(dst);
+    else {
+        memmove(&index->item[i], &index->item[i+1], (index->count-i-1)*sizeof(json_t *));
+        index->count--;
+        if(index->slot) _indexRehash(index);
+    }
+
+    return true;
+}
+
+/* a member of an indexed object is best renamed through jsonLabelMember(), 
+ * which refiles it at once; renamed here, the index it is filed in checks 
+ * its labels before the next lookup and is rebuilt if they changed
+ */
+bool jsonLabelName(json_t *dst, const char *str)
+{
+    size_t len;
+
+    if(!dst || !str) return false;
+    if(dst->indexed) __atomic_add_fetch(&_jsonRenames, 1, __ATOMIC_RELEASE);
+    if(dst->label && !dst->refLabel) jsonMemFree(dst->label);
+    dst->refLabel=false;
+    dst->interned=false;
+
+    len=strlen(str);
+    if((dst->label=_inlineText(dst, str, len, true))) {
+        dst->refLabel=true;
+        return true;
+    }
+
+    dst->label=jsonMemAlloc(len+1);
+    if(!dst->label) return false;
+    strcpy(dst->label, str);
+
+    return true;
+}
+
+/* renames 'member' of the object 'dst' and files it again in the object's 
+ * index, false if it is not a member
+ */
+bool jsonLabelMember(json_t *dst, json_t *member, const char *str)
+{
+    jsonIndex_t *index;
+    json_t *ptr;
+    bool rval;
+
+    if(!dst || !member || !str || dst->type!=JSON_TYPE_OBJECT) return false;
+
+    for(ptr=dst->list; ptr && ptr!=member; ptr=ptr->next);
+    if(!ptr) return false;
+
+    index=_indexFix(dst);
+    member->indexed=false;
+    rval=jsonLabelName(member, str);
+    if(index) _indexRehash(index);
+
+    return rval;
+}
+
+/************************************
+ **  #internal# Scanning Kernels   **
+ ************************************/
+/* Whitespace runs and string bodies are scanned by a block kernel: SSE2 
+ * (16 bytes) is the baseline on x86-64, AVX2 (32 bytes) is picked at run 
+ * time when the CPU has it, other targets use the scalar loop. Build with 
+ * JSON_NO_SIMD (scalar only) or JSON_NO_AVX2 to compare the paths.
+ *
+ * The input is NUL-terminated with unknown length, so the vector kernels 
+ * only do aligned loads: an aligned block never crosses a page boundary, 
+ * reading the bytes behind the terminator is harmless (same as strlen()).
+ */
+#if (defined(__x86_64__) || defined(_M_X64)) && !defined(JSON_NO_SIMD)
+#define JSON_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#define _isWhitespace(c)  ((c)==' ' || (c)=='\n' || (c)=='\r' || (c)=='\t')
+
+const char *_scanWhitespaceScalar(const char *p)
+{
+    while(_isWhitespace(*p)) p++;
+
+    return p;
+}
+
+const char *_scanStringScalar(const char *p)
+{
+    while(*p!='\"' && *p!='\\' && *p!='\0') p++;
+
+    return p;
+}
+
+/* 64-byte block classification for the structural index, one bit per byte */
+typedef struct jsonMasks_t {
+    uint64_t quote;
+    uint64_t backslash;
+    uint64_t op;      // { } [ ] : ,
+    uint64_t ws;
+} jsonMasks_t;
+
+void _classifyScalar(const char *blk, jsonMasks_t *m)
+{
+    uint64_t bit;
+    int i;
+
+    m->quote=m->backslash=m->op=m->ws=0;
+    for(i=0; i<64; i++) {
+        bit=(uint64_t)1<<i;
+        switch(blk[i]) {
+            case '\"': m->quote|=bit; break;
+            case '\\': m->backslash|=bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': m->op|=bit; break;
+            case ' ': case '\n': case '\r': case '\t': m->ws|=bit; break;
+        }
+    }
+}
+
+#ifdef JSON_SIMD_X86
+__attribute__((target("sse2"), no_sanitize_address))
+const char *_scanWhitespaceSse2(const char *p)
+{
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)15);
+    __m128i v, ws;
+    unsigned int mask;
+
+    mask=(0xFFFFu<<(p-blk))&0xFFFFu; // ignore the bytes before p in the first block
+    while(1) {
+        v=_mm_load_si128((const __m128i *)blk);
+        ws=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))), 
+                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        mask&=~(unsigned int)_mm_movemask_epi8(ws);
+        if(mask) return blk+__builtin_ctz(mask);
+
+        blk+=16;
+        mask=0xFFFFu;
+    }
+}
+
+__attribute__((target("sse2"), no_sanitize_address))
+const char *_scanStringSse2(const char *p)
+{
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)15);
+    __m128i v, hit;
+    unsigned int mask;
+
+    mask=0xFFFFu<<(p-blk);
+    while(1) {
+        v=_mm_load_si128((const __m128i *)blk);
+        hit=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))), 
+                         _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        mask&=(unsigned int)_mm_movemask_epi8(hit);
+        if(mask) return blk+__builtin_ctz(mask);
+
+        blk+=16;
+        mask=0xFFFFu;
+    }
+}
+
+/* the block is in bounds, unaligned loads */
+__attribute__((target("sse2")))
+void _classifySse2(const char *blk, jsonMasks_t *m)
+{
+    __m128i v, op, ws;
+    uint64_t bits;
+    int i;
+
+    m->quote=m->backslash=m->op=m->ws=0;
+    for(i=0; i<64; i+=16) {
+        v=_mm_loadu_si128((const __m128i *)(blk+i));
+
+        bits=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\"')));
+        m->quote|=bits<<i;
+        bits=(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        m->backslash|=bits<<i;
+
+        // '[' ']' are '{' '}' without bit 5
+        op=_mm_or_si128(_mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('{')), 
+                        _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('}')));
+        op=_mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        bits=(uint16_t)_mm_movemask_epi8(op);
+        m->op|=bits<<i;
+
+        ws=_mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))), 
+                        _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))));
+        bits=(uint16_t)_mm_movemask_epi8(ws);
+        m->ws|=bits<<i;
+    }
+}
+
+#ifndef JSON_NO_AVX2
+__attribute__((target("avx2"), no_sanitize_address))
+const char *_scanWhitespaceAvx2(const char *p)
+{
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)31);
+    __m256i v, ws;
+    uint32_t mask;
+
+    mask=0xFFFFFFFFu<<(p-blk);
+    while(1) {
+        v=_mm256_load_si256((const __m256i *)blk);
+        ws=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))), 
+                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+        mask&=~(uint32_t)_mm256_movemask_epi8(ws);
+        if(mask) return blk+__builtin_ctz(mask);
+
+        blk+=32;
+        mask=0xFFFFFFFFu;
+    }
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+const char *_scanStringAvx2(const char *p)
+{
+    const char *blk = (const char *)((uintptr_t)p & ~(uintptr_t)31);
+    __m256i v, hit;
+    uint32_t mask;
+
+    mask=0xFFFFFFFFu<<(p-blk);
+    while(1) {
+        v=_mm256_load_si256((const __m256i *)blk);
+        hit=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\'))), 
+                            _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        mask&=(uint32_t)_mm256_movemask_epi8(hit);
+        if(mask) return blk+__builtin_ctz(mask);
+
+        blk+=32;
+        mask=0xFFFFFFFFu;
+    }
+}
+
+__attribute__((target("avx2")))
+void _classifyAvx2(const char *blk, jsonMasks_t *m)
+{
+    __m256i v, op, ws;
+    uint64_t bits;
+    int i;
+
+    m->quote=m->backslash=m->op=m->ws=0;
+    for(i=0; i<64; i+=32) {
+        v=_mm256_loadu_si256((const __m256i *)(blk+i));
+
+        bits=(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\"')));
+        m->quote|=bits<<i;
+        bits=(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        m->backslash|=bits<<i;
+
+        op=_mm256_or_si256(_mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('{')), 
+                           _mm256_cmpeq_epi8(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('}')));
+        op=_mm256_or_si256(op, _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        bits=(uint32_t)_mm256_movemask_epi8(op);
+        m->op|=bits<<i;
+
+        ws=_mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'))), 
+                           _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))));
+        bits=(uint32_t)_mm256_movemask_epi8(ws);
+        m->ws|=bits<<i;
+    }
+}
+#endif
+#endif
+
+/* kernels are resolved on first use */
+const char *_scanWhitespaceInit(const char *p);
+const char *_scanStringInit(const char *p);
+void _classifyInit(const char *blk, jsonMasks_t *m);
+
+const char *(*_scanWhitespace)(const char *p) = _scanWhitespaceInit;
+const char *(*_scanString)(const char *p) = _scanStringInit;
+void (*_classify)(const char *blk, jsonMasks_t *m) = _classifyInit;
+
+void _jsonSimdInit(void)
+{
+#ifdef JSON_SIMD_X86
+#ifndef JSON_NO_AVX2
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        _scanWhitespace=_scanWhitespaceAvx2;
+        _scanString=_scanStringAvx2;
+        _classify=_classifyAvx2;
+        return;
+    }
+#endif
+    _scanWhitespace=_scanWhitespaceSse2;
+    _scanString=_scanStringSse2;
+    _classify=_classifySse2;
+#else
+    _scanWhitespace=_scanWhitespaceScalar;
+    _scanString=_scanStringScalar;
+    _classify=_classifyScalar;
+#endif
+}
+
+const char *_scanWhitespaceInit(const char *p)
+{
+    _jsonSimdInit();
+    return _scanWhitespace(p);
+}
+
+const char *_scanStringInit(const char *p)
+{
+    _jsonSimdInit();
+    return _scanString(p);
+}
+
+void _classifyInit(const char *blk, jsonMasks_t *m)
+{
+    _jsonSimdInit();
+    _classify(blk, m);
+}
+
+/************************************
+ **  #internal# Structural Index   **
+ ************************************/
+/* Stage 1 of the document mode: one pass over the whole input in 64-byte 
+ * blocks lists the offset of every token, i.e. each { } [ ] : , outside 
+ * strings, each opening quote and the first byte of each number or literal. 
+ * Escapes and the in-string state are tracked with bitmask arithmetic, 
+ * carried from block to block. A last offset at 'len' closes the list.
+ */
+/* bits of the characters escaped by a backslash, runs of backslashes 
+ * escape each other pairwise
+ */
+inline uint64_t _escapedBits(jsonStage1_t *st, uint64_t bs)
+{
+    const uint64_t even = 0x5555555555555555ull;
+    uint64_t starts, evenStarts, oddStarts, evenCarries, oddCarries, ends;
+    bool overflow;
+
+    starts=bs & ~(bs<<1);
+    evenStarts=starts & (even^st->oddRun);
+    oddStarts=starts & ~(even^st->oddRun);
+
+    evenCarries=bs+evenStarts;
+    overflow=__builtin_add_overflow(bs, oddStarts, &oddCarries);
+    oddCarries|=st->oddRun;
+    st->oddRun=overflow;
+
+    ends=((evenCarries & ~bs) & ~even) | ((oddCarries & ~bs) & even);
+
+    return ends;
+}
+
+inline uint64_t _prefixXor(uint64_t x)
+{
+    x^=x<<1;
+    x^=x<<2;
+    x^=x<<4;
+    x^=x<<8;
+    x^=x<<16;
+    x^=x<<32;
+
+    return x;
+}
+
+/* token bits of a block */
+inline uint64_t _stage1Block(jsonStage1_t *st, const char *blk)
+{
+    jsonMasks_t m;
+    uint64_t quote, inString, tokens, scalar, delim;
+
+    _classify(blk, &m);
+
+    quote=m.quote & ~_escapedBits(st, m.backslash);
+    inString=_prefixXor(quote)^st->inString;  // opening quotes in, closing ones out
+    st->inString=(uint64_t)((int64_t)inString>>63);
+
+    delim=m.ws | m.op;
+    scalar=~(delim | quote | inString);
+    tokens=(m.op & ~inString) | (quote & inString) | (scalar & ((delim<<1) | st->delim));
+    st->delim=delim>>63;
+
+    return tokens;
+}
+
+/* offsets of the tokens in 'src' (of 'len' bytes), NULL on unterminated 
+ * strings or out of memory
+ */
+uint32_t *_jsonStage1(const char *src, size_t len, size_t *count)
+{
+    jsonStage1_t st = { 0, 0, 1 };   // the input starts after a delimiter
+    char pad[64];
+    uint32_t *rval, *tmp;
+    uint64_t tokens;
+    size_t n, cap, pos;
+
+    if(len>=UINT32_MAX) return NULL;
+
+    cap=len/8+64;
+    rval=jsonMemAlloc(cap*sizeof(uint32_t));
+    if(!rval) return NULL;
+
+    n=0;
+    for(pos=0; pos<len; pos+=64) {
+        if(len-pos>=64) tokens=_stage1Block(&st, src+pos);
+        else {
+            memset(pad, ' ', sizeof(pad));
+            memcpy(pad, src+pos, len-pos);
+            tokens=_stage1Block(&st, pad);
+        }
+
+        if(n+65>cap) {
+            cap*=2;
+            tmp=jsonMemRealloc(rval, cap*sizeof(uint32_t));
+            if(!tmp) {
+                jsonMemFree(rval);
+                return NULL;
+            }
+            rval=tmp;
+        }
+
+        while(tokens) {
+            rval[n++]=pos+__builtin_ctzll(tokens);
+            tokens&=tokens-1;
+        }
+    }
+
+    if(st.inString) {
+        jsonMemFree(rval);
+        return NULL;
+    }
+
+    rval[n]=len;
+    *count=n;
+
+    return rval;
+}
+
+/* bounds of the first value in 'src' (of 'len' bytes) when it is an array 
+ * or object: offsets of its first and last bytes, false for anything else 
+ * or when it does not close; stops scanning right behind the value
+ */
+bool _jsonBoundary(const char *src, size_t len, size_t *first, size_t *last)
+{
+    jsonStage1_t st = { 0, 0, 1 };
+    char pad[64], c;
+    uint64_t tokens;
+    size_t pos, at;
+    long depth;
+
+    depth=-1;   // before the first token
+    for(pos=0; pos<len; pos+=64) {
+        if(len-pos>=64) tokens=_stage1Block(&st, src+pos);
+        else {
+            memset(pad, ' ', sizeof(pad));
+            memcpy(pad, src+pos, len-pos);
+            tokens=_stage1Block(&st, pad);
+        }
+
+        for(; tokens; tokens&=tokens-1) {
+            at=pos+__builtin_ctzll(tokens);
+            c=src[at];
+
+            if(depth<0) {
+                if(c!='[' && c!='{') return false;
+                *first=at;
+                depth=0;
+            }
+
+            if(c=='[' || c=='{') depth++;
+            else if(c==']' || c=='}') {
+                if(--depth==0) {
+                    *last=at;
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+/*************************************
+ **  #internal# Matching Functions  **
+ *************************************/
+/* src := (char **) scanning pointer for whole input string, modify 
+ *     while scanning/parsing in order to keep the progress
+ * cptr := (char *) local temp pointer in each matching function
+ */
+inline char *_skipWhitespace(char **src)
+{
+    // most tokens are followed by no or a single blank, test those inline
+    if(!_isWhitespace(**src)) return *src;
+    (*src)++;
+    if(!_isWhitespace(**src)) return *src;
+
+    *src=(char *)_scanWhitespace(*src);
+
+    return *src;
+}
+
+json_t *_matchNull(char **src, jsonArena_t *arena)
+{
+    json_t *rval;
+
+    if((*src)[0]!='n' && (*src)[0]!='N') return NULL;
+    if((*src)[1]!='u' && (*src)[1]!='U') return NULL;
+    if((*src)[2]!='l' && (*src)[2]!='L') return NULL;
+    if((*src)[3]!='l' && (*src)[3]!='L') return NULL;
+    if(isalnum((*src)[4])) return NULL;
+
+    (*src)+=4;
+    rval=_newNode(arena);
+    if(!jsonSetNull(rval)) return NULL;
+    rval->fixed=(arena!=NULL);
+
+    return rval;
+}
+
+json_t *_matchBooleanTrue(char **src, jsonArena_t *arena)
+{
+    json_t *rval;
+
+    if((*src)[0]!='t' && (*src)[0]!='T') return NULL;
+    if((*src)[1]!='r' && (*src)[1]!='R') return NULL;
+    if((*src)[2]!='u' && (*src)[2]!='U') return NULL;
+    if((*src)[3]!='e' && (*src)[3]!='E') return NULL;
+    if(isalnum((*src)[4])) return NULL;
+
+    (*src)+=4;
+    rval=_newNode(arena);
+    if(!jsonSetBoolean(rval, true)) return NULL;
+    rval->fixed=(arena!=NULL);
+
+    return rval;
+}
+
+json_t *_matchBooleanFalse(char **src, jsonArena_t *arena)
+{
+    json_t *rval;
+
+    if((*src)[0]!='f' && (*src)[0]!='F') return NULL;
+    if((*src)[1]!='a' && (*src)[1]!='A') return NULL;
+    if((*src)[2]!='l' && (*src)[2]!='L') return NULL;
+    if((*src)[3]!='s' && (*src)[3]!='S') return NULL;
+    if((*src)[4]!='e' && (*src)[4]!='E') return NULL;
+    if(isalnum((*src)[5])) return NULL;
+
+    (*src)+=5;
+    rval=_newNode(arena);
+    if(!jsonSetBoolean(rval, false)) return NULL;
+    rval->fixed=(arena!=NULL);
+
+    return rval;
+}
+
+/* buf may point right after the opening quote inside the input itself, 
+ * the string is then unescaped in place (an escape sequence never grows), 
+ * returns the length or -1 on syntax error
+ */
+inline int _getString(char **src, char *buf)
+{
+    char *run, *ptr;
+    int pLen = 0;
+
+    if(**src!='\"') return -1;
+    ptr=(*src)+1;
+
+    // scan to the end double quote or string end   
+    while(1) {
+        run=ptr;
+        ptr=(char *)_scanString(ptr);
+        if(ptr>run) { // bulk copy the clean run
+            if(buf+pLen!=run) memmove(&buf[pLen], run, ptr-run);
+            pLen+=ptr-run;
+        }
+
+        if(*ptr!='\\') break; // '\"' or '\0'
+
+        // escape character
+        ptr++; // (the escape character)
+        switch(*ptr) { // look ahead                    
+            case '\"':
+                buf[pLen++]='\"';
+                break;
+            case '\\':
+                buf[pLen++]='\\';
+                break;
+            case '/':
+                buf[pLen++]='/';
+                break;
+            case 'n':
+                buf[pLen++]='\n';
+                break;
+            case 'r':
+                buf[pLen++]='\r';
+                break;
+            case 't':
+                buf[pLen++]='\t';
+                break;
+            case 'b':
+            case 'f':
+            case 'u':
+                // transparent
+                buf[pLen++]='\\';
+                buf[pLen++]='u'; 
+                break;
+            default: // including '\0'
+                // syntax error
+                return -1;
+        }
+        ptr++; // (the one after escape character)
+    }
+    
+    // syntax error, should end with a double quote
+    if(*ptr=='\0') return -1; 
+    *src=ptr+1; // shift the '\"'
+
+    buf[pLen]='\0';
+
+    return pLen;
+}
+
+/* length of the raw (still escaped) string body, an upper bound of the 
+ * unescaped length, or -1 on syntax error
+ */
+inline int _measureString(const char *src)
+{
+    const char *ptr;
+
+    if(*src!='\"') return -1;
+    ptr=src+1;
+
+    while(1) {
+        ptr=_scanString(ptr);
+        if(*ptr=='\"') break;
+        if(*ptr=='\0' || ptr[1]=='\0') return -1;
+        ptr+=2; // skip the escape sequence
+    }
+
+    return ptr-src-1;
+}
+
+/* unescape the string at *src into its final place: the input itself 
+ * (insitu), the arena, or an exactly sized heap block
+ */
+inline char *_takeString(char **src, jsonArena_t *arena, bool insitu)
+{
+    char *rval;
+    int len;
+
+    if(insitu) {
+        rval=(*src)+1;
+        if(_getString(src, rval)<0) return NULL;
+
+        return rval;
+    }
+
+    len=_measureString(*src);
+    if(len<0) return NULL;
+
+    if(arena) rval=jsonArenaAlloc(arena, len+1);
+    else rval=jsonMemAlloc(len+1);
+    if(!rval) return NULL;
+
+    if(_getString(src, rval)<0) {
+        if(!arena) jsonMemFree(rval);
+        return NULL;
+    }
+
+    return rval;
+}
+
+json_t *_matchString(char **src, jsonArena_t *arena, bool insitu)
+{
+    json_t *rval;
+    char *str;
+    int len;
+
+    // short ones are unescaped straight into the node
+    if(!insitu && (len=_measureString(*src))>=0 && len<JSON_INLINE) {
+        rval=_newNode(arena);
+        if(!jsonSetNull(rval)) return NULL;
+        len=_getString(src, rval->text);
+        if(len<0) {
+            if(!arena) jsonPoolFree(rval, sizeof(json_t));
+            return NULL;
+        }
+
+        rval->type=JSON_TYPE_STRING;
+        rval->string=rval->text;
+        rval->stringLen=len;
+        rval->reference=true;
+        rval->fixed=(arena!=NULL);
+
+        return rval;
+    }
+
+    str=_takeString(src, arena, insitu);
+    if(!str) {
+        // syntax error
+        return NULL;
+    }
+
+    rval=_newNode(arena);
+    if(!jsonRefString(rval, str)) {
+        // error
+        if(!arena && !insitu) jsonMemFree(str);
+        return NULL;
+    }
+    rval->reference=(arena || insitu); // heap copy is owned by the node
+    rval->fixed=(arena!=NULL);
+
+    return rval;
+}
+
+/* Numbers are converted while scanning: up to 19 significant digits are 
+ * accumulated into a 64-bit mantissa, doubles then take Clinger's exact 
+ * fast path or the Eisel-Lemire algorithm, both correctly rounded, and 
+ * strtod() is only left for mantissas truncated ambiguously.
+ */
+static const double _pow10[]={
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11, 
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#ifdef __SIZEOF_INT128__
+/* Eisel-Lemire, w * 10^q rounded to nearest even; returns false when the 
+ * 128-bit product of w and 5^q is too close to a rounding boundary to 
+ * tell, then the caller takes the exact path
+ */
+inline bool _eiselLemire(uint64_t w, int64_t q, bool neg, double *rval)
+{
+    unsigned __int128 first, second;
+    uint64_t hi, lo, mantissa, bits;
+    int64_t power2;
+    int lz, upperbit, shift;
+    int idx;
+
+    if(w==0 || q<JSON_POW5_MIN) { // underflow
+        bits=0;
+        goto done;
+    }
+    if(q>308) { // overflow, 10^309 is beyond DBL_MAX
+        bits=0x7FFull<<52;
+        goto done;
+    }
+
+    lz=__builtin_clzll(w);
+    w<<=lz;
+
+    idx=2*(int)(q-JSON_POW5_MIN);
+    first=(unsigned __int128)w*json_pow5[idx];
+    hi=(uint64_t)(first>>64);
+    lo=(uint64_t)first;
+    if((hi&0x1FF)==0x1FF) { // the lower half of 5^q matters
+        second=(unsigned __int128)w*json_pow5[idx+1];
+        lo+=(uint64_t)(second>>64);
+        if((uint64_t)(second>>64)>lo) hi++;
+        // still all ones below the mantissa, the truncated 5^q may be off by one ulp
+        if((hi&0x1FF)==0x1FF && lo+1==0 && (uint64_t)second+w<w) return false;
+    }
+
+    upperbit=(int)(hi>>63);
+    shift=upperbit+64-52-3;
+    mantissa=hi>>shift;
+    power2=(((152170+65536)*q)>>16)+63+upperbit-lz+1023;
+
+    if(power2<=0) { // subnormal
+        if(-power2+1>=64) {
+            bits=0;
+            goto done;
+        }
+        mantissa>>=-power2+1;
+        mantissa+=(mantissa&1);
+        mantissa>>=1;
+        power2=(mantissa<(1ull<<52)) ? 0 : 1;
+        bits=((uint64_t)power2<<52)|(mantissa&((1ull<<52)-1));
+        goto done;
+    }
+
+    // exactly half-way, round to even
+    if(lo<=1 && q>=-4 && q<=23 && (mantissa&3)==1) {
+        if((mantissa<<shift)==hi) mantissa&=~(uint64_t)1;
+    }
+
+    mantissa+=(mantissa&1);
+    mantissa>>=1;
+    if(mantissa>=(2ull<<52)) {
+        mantissa=1ull<<52;
+        power2++;
+    }
+    mantissa&=~(1ull<<52);
+
+    if(power2>=0x7FF) bits=0x7FFull<<52;
+    else bits=((uint64_t)power2<<52)|mantissa;
+
+done:
+    if(neg) bits|=1ull<<63;
+    memcpy(rval, &bits, sizeof(double));
+
+    return true;
+}
+#endif
+
+/* slow path, strtod() on a copy of [start, end), with the locale's 
+ * decimal point
+ */
+double _slowNumber(const char *start, const char *end)
+{
+    char local[64];
+    char *buf, *ptr;
+    double rval;
+    size_t len;
+
+    len=end-start;
+    buf=(len<sizeof(local)) ? local : jsonMemAlloc(len+1);
+    if(!buf) return NAN;
+
+    memcpy(buf, start, len);
+    buf[len]='\0';
+
+    ptr=strchr(buf, '.');
+    if(ptr) *ptr=*localeconv()->decimal_point;
+
+    rval=strtod(buf, NULL);
+    if(buf!=local) jsonMemFree(buf);
+
+    return rval;
+}
+
+/* returns JSON_TYPE_INTEGER or JSON_TYPE_NUMERIC, -1 on syntax error */
+inline int _getNumber(char **src, int64_t *integer, double *numeric)
+{
+    const char *ptr = *src;
+    uint64_t mantissa = 0;
+    int64_t exp10 = 0, expn;
+    int digits = 0;  // significant digits in mantissa
+    bool neg = false, negExp = false, isReal = false, truncated = false;
+    double value;
+
+    if(*ptr=='-') {
+        neg=true;
+        ptr++;
+    }
+    if(!isdigit(*ptr)) return -1;
+
+    while(isdigit(*ptr)) {
+        if(digits<19) {
+            mantissa=mantissa*10+(*ptr-'0');
+            if(mantissa) digits++;
+        }
+        else {
+            exp10++;
+            if(*ptr!='0') truncated=true;
+        }
+        ptr++;
+    }
+
+    if(*ptr=='.') {
+        isReal=true;
+        ptr++;
+        if(!isdigit(*ptr)) return -1;
+
+        while(isdigit(*ptr)) {
+            if(digits<19) {
+                mantissa=mantissa*10+(*ptr-'0');
+                if(mantissa) digits++;
+                exp10--;
+            }
+            else if(*ptr!='0') truncated=true;
+            ptr++;
+        }
+    }
+
+    if(*ptr=='e' || *ptr=='E') {
+        isReal=true;
+        ptr++;
+        if(*ptr=='-' || *ptr=='+') {
+            negExp=(*ptr=='-');
+            ptr++;
+        }
+        if(!isdigit(*ptr)) return -1;
+
+        expn=0;
+        while(isdigit(*ptr)) {
+            if(expn<100000) expn=expn*10+(*ptr-'0'); // far out of range anyway
+            ptr++;
+        }
+        exp10+=negExp ? -expn : expn;
+    }
+
+    if(!isReal && exp10==0) { // plain integer, check for overflow
+        if(!neg && mantissa<=(uint64_t)INT64_MAX) {
+            *integer=(int64_t)mantissa;
+            *src=(char *)ptr;
+            return JSON_TYPE_INTEGER;
+        }
+        if(neg && mantissa<=(uint64_t)INT64_MAX+1) {
+            *integer=(int64_t)(0-mantissa);
+            *src=(char *)ptr;
+            return JSON_TYPE_INTEGER;
+        }
+        // out of int64 range, keep it as a real number
+    }
+
+    if(!truncated && mantissa<=(1ull<<53) && exp10>=-22 && exp10<=22) {
+        // Clinger: both operands are exact, one rounding
+        value=(double)mantissa;
+        if(exp10<0) value/=_pow10[-exp10];
+        else value*=_pow10[exp10];
+        *numeric=neg ? -value : value;
+    }
+#ifdef __SIZEOF_INT128__
+    else if(!truncated) {
+        if(!_eiselLemire(mantissa, exp10, neg, numeric)) *numeric=_slowNumber(*src, ptr);
+    }
+    else { // the dropped digits only matter if w and w+1 round apart
+        if(!_eiselLemire(mantissa, exp10, neg, numeric) || !_eiselLemire(mantissa+1, exp10, neg, &value) || value!=*numeric) *numeric=_slowNumber(*src, ptr);
+    }
+#else
+    else *numeric=_slowNumber(*src, ptr);
+#endif
+
+    *src=(char *)ptr;
+    return JSON_TYPE_NUMERIC;
+}
+
+json_t *_matchNumber(char **src, jsonArena_t *arena)
+{
+    json_t *rval;
+    int64_t integer;
+    double numeric;
+    int type;
+
+    type=_getNumber(src, &integer, &numeric);
+    if(type<0) {
+        // syntax error
+        return NULL;
+    }
+
+    rval=_newNode(arena);
+    if(!rval) return NULL;
+    if(type==JSON_TYPE_NUMERIC) jsonSetNumeric(rval, numeric);
+    else jsonSetInteger(rval, integer);
+    rval->fixed=(arena!=NULL);
+
+    return rval;
+}
+
+inline json_t *_matchScalar(char **src, jsonArena_t *arena, bool insitu)
+{
+    switch(**src) {
+        case '\"':
+            return _matchString(src, arena, insitu);
+        case '-':
+        case '0':
+        case '1':
+        case '2':
+        case '3':
+        case '4':
+        case '5':
+        case '6':
+        case '7':
+        case '8':
+        case '9':
+            return _matchNumber(src, arena);
+        case 'F':
+            return _matchBooleanFalse(src, arena); 
+        case 'N':
+            return _matchNull(src, arena);
+        case 'T':
+            return _matchBooleanTrue(src, arena);
+        case 'f':
+            return _matchBooleanFalse(src, arena); 
+        case 'n':
+            return _matchNull(src, arena);
+        case 't':
+            return _matchBooleanTrue(src, arena);
+        default:
+            // phrase error
+            return NULL;
+    }
+}
+
+int _jsonMaxDepth = JSON_MAX_DEPTH;  // default of every parse, see jsonSetMaxDepth()
+
+inline int _maxDepth(void)
+{
+    return __atomic_load_n(&_jsonMaxDepth, __ATOMIC_RELAXED);
+}
+
+/* true, false or null in any letter case, returns the type or -1 */
+inline int _getLiteral(char **src, bool *boolean)
+{
+    char *ptr = *src;
+
+    // (c|0x20) folds upper to lower case letters only
+    if((ptr[0]|0x20)=='t' && (ptr[1]|0x20)=='r' && (ptr[2]|0x20)=='u' && (ptr[3]|0x20)=='e' && !isalnum(ptr[4])) {
+        *boolean=true;
+        (*src)+=4;
+        return JSON_TYPE_BOOLEAN;
+    }
+    if((ptr[0]|0x20)=='f' && (ptr[1]|0x20)=='a' && (ptr[2]|0x20)=='l' && (ptr[3]|0x20)=='s' && (ptr[4]|0x20)=='e' && !isalnum(ptr[5])) {
+        *boolean=false;
+        (*src)+=5;
+        return JSON_TYPE_BOOLEAN;
+    }
+    if((ptr[0]|0x20)=='n' && (ptr[1]|0x20)=='u' && (ptr[2]|0x20)=='l' && (ptr[3]|0x20)=='l' && !isalnum(ptr[4])) {
+        (*src)+=4;
+        return JSON_TYPE_NULL;
+    }
+
+    return -1;
+}
+
+/* string at **src as a view: into the input when it has no escapes (or 
+ * 'insitu', where it is unescaped and terminated in place), else into the 
+ * scratch buffer, which only grows
+ */
+inline bool _viewString(char **src, bool insitu, jsonScratch_t *scratch, const char **str, size_t *len)
+{
+    char *start, *ptr, *tmp;
+    int n;
+
+    start=(*src)+1;
+    ptr=(char *)_scanString(start);
+
+    if(*ptr=='\"') {
+        if(insitu) *ptr='\0';
+        *str=start;
+        *len=ptr-start;
+        *src=ptr+1;
+        return true;
+    }
+    if(*ptr=='\0') return false;
+
+    if(insitu) {
+        n=_getString(src, start);
+        if(n<0) return false;
+
+        *str=start;
+        *len=n;
+        return true;
+    }
+
+    n=_measureString(*src);
+    if(n<0) return false;
+
+    if((size_t)n+1>scratch->size) {
+        tmp=jsonMemRealloc(scratch->buf, n+1);
+        if(!tmp) return false;
+        scratch->buf=tmp;
+        scratch->size=n+1;
+    }
+
+    n=_getString(src, scratch->buf);
+    if(n<0) return false;
+
+    *str=scratch->buf;
+    *len=n;
+    return true;
+}
+
+/* the lexer under every tree-building parser: walks one value at **src 
+ * and reports it to 'sax' without recursion, containers open are kept as 
+ * a stack of '[' and '{', a callback returning false stops the walk; 
+ * 'scratch' is kept by the caller for reuse, or NULL for a temporary one
+ */
+inline bool _saxParse(char **src, const jsonSax_t *sax, void *ctx, bool insitu, jsonScratch_t *scratch, int maxDepth)
+{
+    char local[JSON_FRAME_LOCAL*8], *stack, *tmp;
+    jsonScratch_t temp = { NULL, 0 };
+    const char *str;
+    size_t len;
+    int64_t integer;
+    double numeric;
+    bool boolean;
+    int depth, size, type;
+
+    if(!scratch) scratch=&temp;
+    stack=local;
+    size=sizeof(local);
+    depth=0;
+
+    while(1) {
+        // a value, at **src
+        switch(**src) {
+            case '[':
+            case '{':
+                if(depth>=maxDepth) {
+                    json_error=JSON_ERROR_DEPTH;
+                    goto error;
+                }
+                if(depth==size) {
+                    tmp=_stackGrow(stack, local, &size, 1);
+                    if(!tmp) goto error;
+                    stack=tmp;
+                }
+                stack[depth++]=**src;
+
+                if(**src=='{') {
+                    if(sax->startObject && !sax->startObject(ctx)) goto error;
+                }
+                else {
+                    if(sax->startArray && !sax->startArray(ctx)) goto error;
+                }
+
+                (*src)++;
+                _skipWhitespace(src);
+                if(stack[depth-1]=='{') {
+                    if(**src!='}') goto label;
+                }
+                else if(**src!=']') continue;
+                break;  // empty, closed below
+
+            case '\"':
+                if(!_viewString(src, insitu, scratch, &str, &len)) goto error;
+                if(sax->string && !sax->string(ctx, str, len)) goto error;
+                break;
+
+            case '-':
+            case '0':
+            case '1':
+            case '2':
+            case '3':
+            case '4':
+            case '5':
+            case '6':
+            case '7':
+            case '8':
+            case '9':
+                type=_getNumber(src, &integer, &numeric);
+                if(type==JSON_TYPE_INTEGER) {
+                    if(sax->integer && !sax->integer(ctx, integer)) goto error;
+                }
+                else if(type==JSON_TYPE_NUMERIC) {
+                    if(sax->numeric && !sax->numeric(ctx, numeric)) goto error;
+                }
+                else goto error;
+                break;
+
+            default:
+                type=_getLiteral(src, &boolean);
+                if(type==JSON_TYPE_BOOLEAN) {
+                    if(sax->boolean && !sax->boolean(ctx, boolean)) goto error;
+                }
+                else if(type==JSON_TYPE_NULL) {
+                    if(sax->null && !sax->null(ctx)) goto error;
+                }
+                else goto error; // phrase error
+                break;
+        }
+
+        // then separators and closings, up to where the next value starts
+        while(1) {
+            if(depth==0) {
+                jsonMemFree(temp.buf);
+                if(stack!=local) jsonMemFree(stack);
+                return true;
+            }
+
+            _skipWhitespace(src);
+
+            if(**src==',') {
+                (*src)++;
+                _skipWhitespace(src);
+
+                if(stack[depth-1]=='{') goto label;
+                if(**src!=']') break;   // a trailing ',' is let pass in arrays
+            }
+
+            if(**src!=(stack[depth-1]=='{'?'}':']')) goto error;
+            (*src)++;
+
+            depth--;
+            if(stack[depth]=='{') {
+                if(sax->endObject && !sax->endObject(ctx)) goto error;
+            }
+            else {
+                if(sax->endArray && !sax->endArray(ctx)) goto error;
+            }
+        }
+        continue;
+
+label:
+        // the label and the ':' of the next object member
+        if(**src!='\"' || !_viewString(src, insitu, scratch, &str, &len)) goto error;
+        if(sax->key && !sax->key(ctx, str, len)) goto error;
+
+        _skipWhitespace(src);
+        if(**src!=':') goto error;
+        (*src)++; // shift the ':'
+        _skipWhitespace(src);
+    }
+
+error:
+    if(json_error!=JSON_ERROR_DEPTH && json_error!=JSON_ERROR_MEMORY) json_error=JSON_ERRPR_PHRASE;
+    jsonMemFree(temp.buf);
+    if(stack!=local) jsonMemFree(stack);
+
+    return false;
+}
+
+/* the tree builder, a client of _saxParse() */
+/* a copy of the view (or the view itself in situ) */
+inline char *_buildText(jsonBuilder_t *b, const char *str, size_t len)
+{
+    char *rval;
+
+    if(b->insitu) return (char *)str;
+
+    if(b->arena) rval=jsonArenaAlloc(b->arena, len+1);
+    else rval=jsonMemAlloc(len+1);
+    if(!rval) return NULL;
+
+    memcpy(rval, str, len);
+    rval[len]='\0';
+
+    return rval;
+}
+
+inline bool _buildAttach(jsonBuilder_t *b, json_t *value)
+{
+    jsonFrame_t *top;
+
+    if(!value) return false;
+    value->fixed=(b->arena!=NULL);
+
+    if(b->depth==0) {
+        b->root=value;
+        return true;
+    }
+
+    top=&b->stack[b->depth-1];
+    if(top->tail) top->tail->next=value;
+    else top->node->list=value;
+    top->tail=value;
+    top->count++;
+
+    if(b->label==b->labelBuf) {
+        b->label=NULL;
+        value->label=_inlineText(value, b->labelBuf, b->labelLen, true);
+        if(value->label) value->refLabel=true;
+        else {
+            value->label=_buildText(b, b->labelBuf, b->labelLen);
+            if(!value->label) return false;
+            value->refLabel=(b->arena!=NULL);
+        }
+    }
+    else if(b->label) {
+        value->label=b->label;
+        value->refLabel=(b->arena || b->insitu || b->keys);
+        value->interned=(b->keys!=NULL);
+        b->label=NULL;
+    }
+
+    return true;
+}
+
+inline bool _buildOpen(jsonBuilder_t *b, bool object)
+{
+    jsonFrame_t *tmp;
+    json_t *node;
+
+    node=_newNode(b->arena);
+    if(!node) return false;
+    if(object) jsonSetObject(node, NULL);
+    else jsonSetArray(node, NULL);
+    _listSetArena(node, b->arena);
+    if(!_buildAttach(b, node)) return false;  // linked already, freed with the root
+
+    if(b->depth==b->size) {
+        tmp=_stackGrow(b->stack, b->local, &b->size, sizeof(jsonFrame_t));
+        if(!tmp) return false;
+        b->stack=tmp;
+    }
+
+    b->stack[b->depth].node=node;
+    b->stack[b->depth].tail=NULL;
+    b->stack[b->depth].count=0;
+    b->depth++;
+
+    return true;
+}
+
+bool _buildStartObject(void *ctx)
+{
+    return _buildOpen(ctx, true);
+}
+
+bool _buildStartArray(void *ctx)
+{
+    return _buildOpen(ctx, false);
+}
+
+bool _buildEnd(void *ctx)
+{
+    jsonBuilder_t *b = ctx;
+    jsonFrame_t *top;
+
+    top=&b->stack[--b->depth];
+
+    // large lists are indexed once complete
+    if(top->count>JSON_INDEX_MIN) _indexBuild(top->node);
+
+    return true;
+}
+
+bool _buildKey(void *ctx, const char *str, size_t len)
+{
+    jsonBuilder_t *b = ctx;
+
+    if(b->keys) b->label=_keysIntern(b->keys, str, len);
+    else if(!b->insitu && len<JSON_INLINE) {
+        // kept aside until the node it labels is there
+        memcpy(b->labelBuf, str, len);
+        b->labelLen=len;
+        b->label=b->labelBuf;
+    }
+    else b->label=_buildText(b, str, len);
+
+    return b->label!=NULL;
+}
+
+bool _buildString(void *ctx, const char *str, size_t len)
+{
+    jsonBuilder_t *b = ctx;
+    json_t *value;
+    char *text;
+
+    if(!b->insitu && len<JSON_INLINE) {
+        value=_newNode(b->arena);
+        if(!jsonSetNull(value)) return false;
+        value->type=JSON_TYPE_STRING;
+        value->string=_inlineText(value, str, len, false);
+        value->reference=true;
+        return _buildAttach(b, value);
+    }
+
+    text=_buildText(b, str, len);
+    if(!text) return false;
+
+    value=_newNode(b->arena);
+    if(!jsonRefString(value, text)) {
+        if(!b->arena && !b->insitu) jsonMemFree(text);
+        return false;
+    }
+    value->reference=(b->arena || b->insitu); // heap copy is owned by the node
+
+    return _buildAttach(b, value);
+}
+
+bool _buildInteger(void *ctx, int64_t integer)
+{
+    jsonBuilder_t *b = ctx;
+    json_t *value;
+
+    value=_newNode(b->arena);
+    if(!jsonSetInteger(value, integer)) return false;
+
+    return _buildAttach(b, value);
+}
+
+bool _buildNumeric(void *ctx, double numeric)
+{
+    jsonBuilder_t *b = ctx;
+    json_t *value;
+
+    value=_newNode(b->arena);
+    if(!jsonSetNumeric(value, numeric)) return false;
+
+    return _buildAttach(b, value);
+}
+
+bool _buildBoolean(void *ctx, bool boolean)
+{
+    jsonBuilder_t *b = ctx;
+    json_t *value;
+
+    value=_newNode(b->arena);
+    if(!jsonSetBoolean(value, boolean)) return false;
+
+    return _buildAttach(b, value);
+}
+
+bool _buildNull(void *ctx)
+{
+    jsonBuilder_t *b = ctx;
+    json_t *value;
+
+    value=_newNode(b->arena);
+    if(!jsonSetNull(value)) return false;
+
+    return _buildAttach(b, value);
+}
+
+const jsonSax_t _jsonBuilderSax = {
+    _buildStartObject, _buildEnd, _buildStartArray, _buildEnd, _buildKey,
+    _buildString, _buildInteger, _buildNumeric, _buildBoolean, _buildNull
+};
+
+/* every value is linked into its parent right away, so the partial tree 
+ * can be freed from the root on errors
+ */
+inline bool _buildRun(jsonBuilder_t *b, char **src, jsonScratch_t *scratch)
+{
+    if(!_saxParse(src, &_jsonBuilderSax, b, b->insitu, scratch, b->maxDepth)) {
+        if(b->label && b->label!=b->labelBuf && !b->arena && !b->insitu && !b->keys) jsonMemFree(b->label);
+        if(!b->arena) jsonFree(b->root);
+        b->root=NULL;
+        return false;
+    }
+
+    json_error=JSON_ERROR_NONE;
+    return true;
+}
+
+json_t *_buildValue(char **src, jsonArena_t *arena, bool insitu, jsonKeys_t *keys)
+{
+    jsonBuilder_t b;
+
+    b.arena=arena;
+    b.insitu=insitu;
+    b.keys=keys;
+    b.maxDepth=_maxDepth();
+    b.stack=b.local;
+    b.size=JSON_FRAME_LOCAL;
+    b.depth=0;
+    b.root=NULL;
+    b.label=NULL;
+
+    _buildRun(&b, src, NULL);
+    if(b.stack!=b.local) jsonMemFree(b.stack);
+
+    return b.root;
+}
+
+/*************************
+ **  Utility Functions  **
+ *************************/
+
+/* nesting limit for the parsers, arrays and objects deeper than 'depth' 
+ * are a parse error; parses already running keep the limit they started 
+ * with, a jsonParser_t takes it as its default (see jsonParserSetMaxDepth())
+ */
+void jsonSetMaxDepth(int depth)
+{
+    __atomic_store_n(&_jsonMaxDepth, (depth>0)?depth:JSON_MAX_DEPTH, __ATOMIC_RELAXED);
+}
+
+/* walks 'str' and reports its values to the callbacks in 'sax' (NULL ones 
+ * are skipped) without building anything, the string views are not 
+ * NUL-terminated and only valid during the callback
+ */
+bool jsonSaxParse(const char *str, const jsonSax_t *sax, void *ctx)
+{
+    char *src = (char *)str;  // read only, not in situ
+
+    if(!str || !sax) return false;
+
+    json_error=JSON_ERROR_NONE;
+    _skipWhitespace(&src);
+    return _saxParse(&src, sax, ctx, false, NULL, _maxDepth());
+}
+
+json_t *jsonParse(char *str)
+{
+    json_error=JSON_ERROR_NONE;
+    _skipWhitespace(&str);
+    return _buildValue(&str, NULL, false, NULL);
+}
+
+json_t *jsonParseInArena(jsonArena_t *arena, char *str)
+{
+    if(!arena || !str) return NULL;
+
+    json_error=JSON_ERROR_NONE;
+    _skipWhitespace(&str);
+    return _buildValue(&str, arena, false, NULL);
+}
+
+/* parses with the labels interned into 'keys', 'arena' is optional */
+json_t *jsonParseWithKeys(char *str, jsonArena_t *arena, jsonKeys_t *keys)
+{
+    if(!str || !keys) return NULL;
+
+    json_error=JSON_ERROR_NONE;
+    _skipWhitespace(&str);
+    return _buildValue(&str, arena, false, keys);
+}
+
+/* destructive, zero-copy parsing: strings and labels are unescaped inside 
+ * 'str' and referred to by the nodes, so 'str' must outlive the result, 
+ * 'arena' is optional (NULL for heap nodes)
+ */
+json_t *jsonParseInSitu(char *str, jsonArena_t *arena)
+{
+    if(!str) return NULL;
+
+    json_error=JSON_ERROR_NONE;
+    _skipWhitespace(&str);
+    return _buildValue(&str, arena, true, NULL);
+}
+
+/* parses 'len' bytes of 'buf', which needs no NUL terminator and is only 
+ * read: an array or object is parsed right from 'buf' once the structural 
+ * scan has found where it closes, so the lexer stops inside the buffer; 
+ * anything else goes through a terminated copy
+ */
+json_t *_jsonParseN(const char *buf, size_t len, jsonArena_t *arena)
+{
+    json_t *rval;
+    char *src, *copy;
+    size_t first, last;
+
+    if(!buf) return NULL;
+
+    json_error=JSON_ERROR_NONE;
+    if(_jsonBoundary(buf, len, &first, &last)) {
+        src=(char *)buf+first;  // read only, not in situ
+        return _buildValue(&src, arena, false, NULL);
+    }
+
+    if(arena) copy=jsonArenaAlloc(arena, len+1);
+    else copy=jsonMemAlloc(len+1);
+    if(!copy) return NULL;
+    memcpy(copy, buf, len);
+    copy[len]='\0';
+
+    src=copy;
+    _skipWhitespace(&src);
+    rval=_buildValue(&src, arena, false, NULL);
+    if(!arena) jsonMemFree(copy);
+
+    return rval;
+}
+
+json_t *jsonParseN(const char *buf, size_t len)
+{
+    return _jsonParseN(buf, len, NULL);
+}
+
+/* parses a file through a read-only memory mapping */
+json_t *jsonParseFile(const char *path)
+{
+    struct stat st;
+    json_t *rval;
+    void *map;
+    int fd;
+
+    if(!path) return NULL;
+
+    fd=open(path, O_RDONLY);
+    if(fd<0) return NULL;
+
+    if(fstat(fd, &st)<0 || st.st_size==0) {
+        close(fd);
+        return NULL;
+    }
+
+    map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map==MAP_FAILED) return NULL;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    rval=jsonParseN(map, st.st_size);
+
+    munmap(map, st.st_size);
+
+    return rval;
+}
+
+inline json_t *_queryArray(json_t *value, char **src)
+{
+    char buf[32];
+    int i;
+
+    if(**src!='[') return NULL;  // syntax error
+    else (*src)++;
+
+    i=0;
+    while(isdigit(**src) && i<9) {
+        buf[i++]=**src;
+        (*src)++;
+    }
+
+    if(**src!=']') return NULL;  // syntax error
+    (*src)++;
+    if(**src=='.') (*src)++;    // "a[1].b"
+    buf[i]='\0';
+
+    return _arrayMember(value, atoi(buf));
+}
+
+inline json_t *_queryObject(json_t *value, char **src)
+{
+    char buf[256];
+    int i;
+
+    i=0;
+    while(isalnum(**src) && i<(int)sizeof(buf)-1) {
+        buf[i++]=**src;
+        (*src)++;
+    }
+    if(**src!='.' && **src!='[' && **src!='\0') return NULL; // syntax error
+    if(**src=='.') (*src)++;
+    buf[i]='\0';
+
+    return _objectMember(value, buf, _jsonHash(buf, i));
+}
+
+json_t *jsonQuery(json_t *root, const char *str)
+{
+    json_t *currentLevel, *accessPtr;
+
+    if(!root) return NULL;
+
+    if(!str) return root;
+    if(strlen(str)==0) return root;
+
+    currentLevel=root;
+    while(*str!='\0') {
+        if(currentLevel->type==JSON_TYPE_ARRAY) accessPtr=_queryArray(currentLevel, (char **)&str);
+        else if(currentLevel->type==JSON_TYPE_OBJECT) accessPtr=_queryObject(currentLevel, (char **)&str);
+        else return NULL;
+
+        if(!accessPtr) break; 
+        currentLevel=accessPtr;
+    }
+
+    return accessPtr;
+}
+
+bool jsonEqNull(json_t *value)
+{
+    if(!value) return true;
+
+    switch(value->type) {
+        case JSON_TYPE_NULL:
+            return true;
+        case JSON_TYPE_STRING:
+            if(strlen(value->string)==0) return true;
+            else return false;
+        case JSON_TYPE_INTEGER:
+            if(value->integer==0) return true;
+            else return false;
+        case JSON_TYPE_NUMERIC:
+            if(value->numeric==0) return true;
+            else return false;
+        case JSON_TYPE_ARRAY:
+        case JSON_TYPE_OBJECT:
+            if(value->list==NULL) return true;
+            else return false;
+        default: // JSON_TYPE_BOOLEAN
+            return false;
+    }
+}
+
+bool jsonEqBoolean(json_t *value)
+{
+    if(!value) return false;
+
+    switch(value->type) {
+        case JSON_TYPE_BOOLEAN:
+            return value->boolean;
+        case JSON_TYPE_STRING:
+            if(strlen(value->string)) return true;
+            else return false;
+        case JSON_TYPE_INTEGER:
+            if(value->integer) return true;
+            else return false;
+        case JSON_TYPE_NUMERIC:
+            if(value->numeric) return true;
+            else return false;
+        case JSON_TYPE_ARRAY:
+        case JSON_TYPE_OBJECT:
+            if(value->list) return true;
+            else return false;
+        default: // JSON_TYPE_NULL
+            return false;
+    }
+}
+
+int64_t jsonGetInteger(json_t *value)
+{
+    if(!value) return 0;
+
+    switch(value->type) {
+        case JSON_TYPE_BOOLEAN:
+            return (int64_t)value->boolean;
+        case JSON_TYPE_STRING:
+            return strtoll(value->string, NULL, 10);
+        case JSON_TYPE_INTEGER:
+            return value->integer;
+        case JSON_TYPE_NUMERIC:
+            return (int64_t)value->numeric;
+        default: // JSON_TYPE_NULL, JSON_TYPE_ARRAY, JSON_TYPE_OBJECT
+            return 0;
+    }
+}
+
+double jsonGetNumeric(json_t *value)
+{
+    if(!value) return 0;
+
+    switch(value->type) {
+        case JSON_TYPE_NULL:
+            return 0;
+        case JSON_TYPE_BOOLEAN:
+            if(value->boolean) return 1;
+            else return 0;
+        case JSON_TYPE_STRING:
+            return strtod(value->string, NULL);
+        case JSON_TYPE_INTEGER:
+            return (double)value->integer;
+        case JSON_TYPE_NUMERIC:
+            return value->numeric;
+        default: // JSON_TYPE_ARRAY, JSON_TYPE_OBJECT
+            return NAN;
+    }
+}
+
+/* Number formatting: integers are written two digits at a time from a 
+ * table, doubles as the shortest decimal that reads back to the same 
+ * value (Schubfach, R. Giulietti), using the power table of json_pow5.h.
+ */
+static const char _digits2[]=
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const uint64_t _pow10u[]={
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull, 
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull, 
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull
+};
+
+inline int _countDigits(uint64_t u)
+{
+    int n;
+
+    n=((64-__builtin_clzll(u|1))*1233)>>12; // ~ log10
+    return n+((u|1)>=_pow10u[n]);
+}
+
+/* writes exactly n digits of u, u < 10^n */
+inline void _writeDigits(char *buf, uint64_t u, int n)
+{
+    char *ptr = buf+n;
+    int i;
+
+    while(u>=100) {
+        i=(int)(u%100)*2;
+        u/=100;
+        *--ptr=_digits2[i+1];
+        *--ptr=_digits2[i];
+    }
+    if(u>=10) {
+        *--ptr=_digits2[u*2+1];
+        *--ptr=_digits2[u*2];
+    }
+    else *--ptr='0'+(char)u;
+}
+
+inline int _formatInteger(char *buf, int64_t value)
+{
+    uint64_t u;
+    int n, neg;
+
+    neg=(value<0);
+    u=neg ? 0-(uint64_t)value : (uint64_t)value;
+    n=_countDigits(u);
+
+    buf[0]='-';
+    _writeDigits(&buf[neg], u, n);
+
+    return n+neg;
+}
+
+#ifdef __SIZEOF_INT128__
+/* 126-bit g = floor(10^-k * 2^r)+1 of Schubfach, split into 63-bit halves */
+inline void _schubfachG(int k, uint64_t *g1, uint64_t *g0)
+{
+    const uint64_t *t = &json_pow5[2*(-k-JSON_POW5_MIN)];
+    unsigned __int128 g;
+
+    g=((unsigned __int128)t[0]<<64)|t[1];
+    if(-k>=-27 && -k<0) g--; // these entries are rounded up, the others truncated
+    g=(g>>2)+1;
+
+    *g1=(uint64_t)(g>>63);
+    *g0=(uint64_t)g&0x7FFFFFFFFFFFFFFFull;
+}
+
+inline uint64_t _schubfachRop(uint64_t g1, uint64_t g0, uint64_t cp)
+{
+    uint64_t x1, y0, y1, z, vbp;
+
+    x1=(uint64_t)(((unsigned __int128)g0*cp)>>64);
+    y0=g1*cp;
+    y1=(uint64_t)(((unsigned __int128)g1*cp)>>64);
+    z=(y0>>1)+x1;
+    vbp=y1+(z>>63);
+
+    return vbp|(((z&0x7FFFFFFFFFFFFFFFull)+0x7FFFFFFFFFFFFFFFull)>>63);
+}
+
+/* shortest f * 10^e in the rounding interval of c * 2^q */
+inline void _schubfach(int q, uint64_t c, uint64_t *f, int *e)
+{
+    uint64_t cb, cbl, cbr, g1, g0, vb, vbl, vbr, s, t, sp10, tp10;
+    int64_t cmp;
+    int out, k, h;
+    bool uin, win;
+
+    out=(int)(c&1);
+    cb=c<<2;
+    cbr=cb+2;
+    if(c!=(1ull<<52) || q==-1074) {
+        cbl=cb-2;
+        k=(int)(((int64_t)q*661971961083ll)>>41);  // floor(q log10(2))
+    }
+    else { // closer lower neighbour at a power of two
+        cbl=cb-1;
+        k=(int)(((int64_t)q*661971961083ll-274743187321ll)>>41);
+    }
+    h=q+(int)(((int64_t)-k*913124641741ll)>>38)+2; // floor(-k log2(10))
+
+    _schubfachG(k, &g1, &g0);
+    vb=_schubfachRop(g1, g0, cb<<h);
+    vbl=_schubfachRop(g1, g0, cbl<<h);
+    vbr=_schubfachRop(g1, g0, cbr<<h);
+
+    s=vb>>2;
+    if(s>=10) {  // one digit less, if that still reads back
+        sp10=10*(uint64_t)(((unsigned __int128)s*(115292150460684698ull<<4))>>64);
+        tp10=sp10+10;
+        uin=(vbl+out<=sp10<<2);
+        win=((tp10<<2)+out<=vbr);
+        if(uin!=win) {
+            *f=uin ? sp10 : tp10;
+            *e=k;
+            return;
+        }
+    }
+
+    t=s+1;
+    uin=(vbl+out<=s<<2);
+    win=((t<<2)+out<=vbr);
+    if(uin!=win) {
+        *f=uin ? s : t;
+        *e=k;
+        return;
+    }
+
+    cmp=(int64_t)(vb-((s+t)<<1));
+    *f=(cmp<0 || (cmp==0 && (s&1)==0)) ? s : t;
+    *e=k;
+}
+#endif
+
+/* shortest round-trip text, "1.5", "0.001", "2.0" (keeps reading back as 
+ * a numeric), "1e-9" style exponents outside [1e-6, 1e21), "null" for 
+ * NaN and infinities which JSON can not express
+ */
+inline int _formatNumeric(char *buf, double value)
+{
+    char digits[20];
+    uint64_t bits, mant, f;
+    int biased, e, n, point, len, i;
+
+    memcpy(&bits, &value, sizeof(double));
+    biased=(int)(bits>>52)&0x7FF;
+    mant=bits&((1ull<<52)-1);
+
+    if(biased==0x7FF) {
+        memcpy(buf, "null", 4);
+        return 4;
+    }
+
+    len=0;
+    if(bits>>63) buf[len++]='-';
+
+    if(biased==0 && mant==0) {
+        memcpy(&buf[len], "0.0", 3);
+        return len+3;
+    }
+
+#ifdef __SIZEOF_INT128__
+    if(biased) {
+        mant|=1ull<<52;
+        // integers below 2^53 need no search
+        if(1075-biased>0 && 1075-biased<53 && ((mant>>(1075-biased))<<(1075-biased))==mant) {
+            f=mant>>(1075-biased);
+            e=0;
+        }
+        else _schubfach(biased-1075, mant, &f, &e);
+    }
+    else _schubfach(-1074, mant, &f, &e);
+#else
+    {
+        char tmp[32], *ptr;
+        // no 128-bit arithmetic, fall back to 17 significant digits
+        snprintf(tmp, sizeof(tmp), "%.16e", value<0 ? -value : value);
+        f=0;
+        for(ptr=tmp; *ptr!='e'; ptr++) if(isdigit(*ptr)) f=f*10+(*ptr-'0');
+        e=atoi(ptr+1)-16;
+    }
+#endif
+
+    while(f%10==0) { // trailing zeros belong to the exponent
+        f/=10;
+        e++;
+    }
+
+    n=_countDigits(f);
+    _writeDigits(digits, f, n);
+    point=n+e; // position of the decimal point within the digits
+
+    if(point>0 && point<=21) {
+        if(n<=point) { // integral
+            memcpy(&buf[len], digits, n);
+            len+=n;
+            for(i=n; i<point; i++) buf[len++]='0';
+            memcpy(&buf[len], ".0", 2);
+            len+=2;
+        }
+        else {
+            memcpy(&buf[len], digits, point);
+            len+=point;
+            buf[len++]='.';
+            memcpy(&buf[len], &digits[point], n-point);
+            len+=n-point;
+        }
+    }
+    else if(point<=0 && point>-6) {
+        buf[len++]='0';
+        buf[len++]='.';
+        for(i=point; i<0; i++) buf[len++]='0';
+        memcpy(&buf[len], digits, n);
+        len+=n;
+    }
+    else {
+        buf[len++]=digits[0];
+        if(n>1) {
+            buf[len++]='.';
+            memcpy(&buf[len], &digits[1], n-1);
+            len+=n-1;
+        }
+        buf[len++]='e';
+        e=point-1;
+        if(e<0) {
+            buf[len++]='-';
+            e=-e;
+        }
+        else buf[len++]='+';
+        len+=_formatInteger(&buf[len], e);
+    }
+
+    return len;
+}
+
+/* Serializer output, bounded by 'size' (including the terminating NUL) 
+ * while 'len' keeps counting: run once with size 0 to measure, then once 
+ * more into an exactly sized buffer.
+ */
+inline void _writeRaw(jsonWriter_t *w, const char *str, size_t n)
+{
+    size_t room;
+
+    if(w->len+n<w->size) memcpy(&w->buf[w->len], str, n);
+    else if(w->len+1<w->size) {
+        room=w->size-w->len-1; // truncated output
+        memcpy(&w->buf[w->len], str, room);
+    }
+    w->len+=n;
+}
+
+inline void _writeChar(jsonWriter_t *w, char c)
+{
+    if(w->len+1<w->size) w->buf[w->len]=c;
+    w->len++;
+}
+
+inline void _writeEsc(jsonWriter_t *w, const char *src)
+{
+    const char *run;
+    char esc[2];
+
+    esc[0]='\\';
+    while(*src!='\0') {
+        run=src;
+        while(*src!='\0' && *src!='\t' && *src!='\n' && *src!='\r' && *src!='\"' && *src!='\\') src++;
+        if(src>run) _writeRaw(w, run, src-run);
+        if(*src=='\0') break;
+
+        switch(*src) {
+            case '\t':
+                esc[1]='t';
+                break;
+            case '\n':
+                esc[1]='n';
+                break;
+            case '\r':
+                esc[1]='r';
+                break;
+            default: // '\"' and '\\'
+                esc[1]=*src;
+        }
+        _writeRaw(w, esc, 2);
+        src++;
+    }
+}
+
+inline void _fillPureValStrBuf(json_t *value, bool esc, jsonWriter_t *w)
+{
+    char buf[32];
+
+    switch(value->type) {
+        case JSON_TYPE_NULL:
+            _writeRaw(w, "null", 4);
+            break;
+        case JSON_TYPE_BOOLEAN:
+            if(value->boolean) _writeRaw(w, "true", 4);
+            else _writeRaw(w, "false", 5);
+            break;
+        case JSON_TYPE_STRING:
+            if(esc) _writeEsc(w, value->string);
+            else _writeRaw(w, value->string, strlen(value->string));
+            break;
+        case JSON_TYPE_INTEGER:
+            _writeRaw(w, buf, _formatInteger(buf, value->integer));
+            break;
+        case JSON_TYPE_NUMERIC:
+            _writeRaw(w, buf, _formatNumeric(buf, value->numeric));
+            break;
+        default:
+            _writeRaw(w, "(type error)", 12);
+    }
+}
+
+/* what goes before a member of 'list' */
+inline void _writeLead(jsonWriter_t *w, json_t *list, json_t *member)
+{
+    if(list->type==JSON_TYPE_ARRAY) {
+        _writeChar(w, ' '); // for pretty   XD
+        return;
+    }
+
+    _writeRaw(w, " \"", 2); // (space for pretty)
+    if(member->label) _writeEsc(w, member->label);
+    _writeRaw(w, "\": ", 3); // (space for pretty)
+}
+
+/* writes 'value' without recursion, the arrays and objects open wait on 
+ * an explicit stack like in jsonFree(); false if that can not grow
+ */
+bool _fillOptStrBuf(json_t *value, jsonWriter_t *w)
+{
+    json_t *local[JSON_FRAME_LOCAL], **stack, **tmp;
+    int depth, size;
+
+    stack=local;
+    size=JSON_FRAME_LOCAL;
+    depth=0;
+
+    while(1) {
+        switch(value->type) {
+            case JSON_TYPE_STRING:
+                _writeChar(w, '\"');
+                _fillPureValStrBuf(value, true, w);
+                _writeChar(w, '\"');
+                break;
+            case JSON_TYPE_ARRAY:
+            case JSON_TYPE_OBJECT:
+                if(value->list && depth==size) {
+                    tmp=_stackGrow(stack, local, &size, sizeof(json_t *));
+                    if(!tmp) goto error;
+                    stack=tmp;
+                }
+
+                _writeChar(w, (value->type==JSON_TYPE_ARRAY)?'[':'{');
+                if(value->list) {
+                    stack[depth++]=value;
+                    value=value->list;
+                    _writeLead(w, stack[depth-1], value);
+                    continue;
+                }
+                _writeRaw(w, (value->type==JSON_TYPE_ARRAY)?" ]":" }", 2); // (space for pretty)
+                break;
+            default:
+                _fillPureValStrBuf(value, true, w);
+        }
+
+        // a value is done, and so are the lists it was the last member of
+        while(depth>0 && !value->next) {
+            value=stack[--depth];
+            _writeRaw(w, (value->type==JSON_TYPE_ARRAY)?" ]":" }", 2);
+        }
+        if(depth==0) break;
+
+        _writeChar(w, ',');
+        value=value->next;
+        _writeLead(w, stack[depth-1], value);
+    }
+
+    if(stack!=local) jsonMemFree(stack);
+
+    return true;
+
+error:
+    if(stack!=local) jsonMemFree(stack);
+
+    return false;
+}
+
+inline bool _jsonWrite(json_t *value, bool json, jsonWriter_t *w)
+{
+    bool rval = true;
+
+    if(json || value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) rval=_fillOptStrBuf(value, w);
+    else _fillPureValStrBuf(value, false, w);
+
+    if(w->size) w->buf[w->len<w->size ? w->len : w->size-1]='\0';
+
+    return rval;
+}
+
+/* writes what jsonGetString() returns into buf (at most size bytes, always 
+ * NUL-terminated), returns the full length without the NUL, like snprintf(); 
+ * 0 with JSON_ERROR_MEMORY if the nesting is too deep for the memory left
+ */
+size_t jsonWriteString(json_t *value, char *buf, size_t size)
+{
+    jsonWriter_t w;
+
+    if(!value) return 0;
+
+    w.buf=buf;
+    w.size=buf ? size : 0;
+    w.len=0;
+    if(!_jsonWrite(value, false, &w)) return 0;
+
+    return w.len;
+}
+
+/* same as jsonWriteString(), but string values are always quoted and 
+ * escaped, so the output is valid JSON text for any value
+ */
+size_t jsonWriteJson(json_t *value, char *buf, size_t size)
+{
+    jsonWriter_t w;
+
+    if(!value) return 0;
+
+    w.buf=buf;
+    w.size=buf ? size : 0;
+    w.len=0;
+    if(!_jsonWrite(value, true, &w)) return 0;
+
+    return w.len;
+}
+
+char *jsonGetString(json_t *value)
+{
+    jsonWriter_t w;
+    char *rval;
+
+    if(!value) return NULL;
+
+    w.buf=NULL;
+    w.size=0;
+    w.len=0;
+    if(!_jsonWrite(value, false, &w)) return NULL;
+
+    rval=jsonMemAlloc(w.len+1);
+    if(!rval) return NULL;
+
+    w.buf=rval;
+    w.size=w.len+1;
+    w.len=0;
+    if(!_jsonWrite(value, false, &w)) {
+        jsonMemFree(rval);
+        return NULL;
+    }
+
+    return rval;
+}
+
+int jsonListCount(json_t *value)
+{
+    int count;
+    json_t *ptr;
+
+    if(!value) return -1;
+
+    if(value->type!=JSON_TYPE_ARRAY && value->type!=JSON_TYPE_OBJECT) return -1;
+    if(_indexOf(value)) return _indexOf(value)->count;
+
+    count=0;
+    for(ptr=value->list; ptr!=NULL; ptr=ptr->next) count++;
+
+    return count;
+}
+
+json_t *jsonListAt(json_t *value, int n)
+{
+    json_t *ptr;
+    int count;
+
+    if(!value) return NULL;
+    if(value->type!=JSON_TYPE_ARRAY && value->type!=JSON_TYPE_OBJECT) return NULL;
+
+    count=jsonListCount(value);
+    if(n<0) n+=count;   // from the end
+    if(n<0 || n>=count) return NULL;
+
+    if(_indexOf(value)) return _indexOf(value)->item[n];
+
+    for(ptr=value->list; n>0; n--) ptr=ptr->next;
+
+    return ptr;
+}
+
+/* a single node, without its members and siblings */
+inline json_t *_jsonCopy(json_t *value, bool label)
+{
+    json_t *rval;
+    size_t len;
+
+    rval=jsonPoolAlloc(sizeof(json_t));
+    if(!rval) return NULL;
+    memcpy(rval, value, sizeof(json_t));
+
+    rval->fixed=false;      // the copy always lives on the heap
+    rval->reference=false;  // and owns its contents
+    rval->refLabel=false;
+    rval->interned=false;
+    rval->indexed=false;
+    rval->label=NULL;
+    rval->next=NULL;
+
+    if(rval->type==JSON_TYPE_STRING) {
+        len=strlen(value->string);
+        if((rval->string=_inlineText(rval, value->string, len, false))) rval->reference=true;
+        else {
+            rval->string=jsonMemAlloc(len+1);
+            if(!rval->string) {
+                jsonPoolFree(rval, sizeof(json_t));
+                return NULL;
+            }
+            strcpy(rval->string, value->string);
+        }
+    }
+    else if(rval->type==JSON_TYPE_ARRAY || rval->type==JSON_TYPE_OBJECT) {
+        rval->index=NULL;   // built by jsonCopy() once the members are there
+        rval->arenaRef=false;
+        rval->list=NULL;
+    }
+
+    if(label && value->label) {
+        len=strlen(value->label);
+        if((rval->label=_inlineText(rval, value->label, len, true))) rval->refLabel=true;
+        else {
+            rval->label=jsonMemAlloc(len+1);
+            if(!rval->label) {
+                jsonFree(rval);
+                return NULL;
+            }
+            strcpy(rval->label, value->label);
+        }
+    }
+
+    return rval;
+}
+
+/* deep copy of 'value' (not its label and siblings), members are copied 
+ * level by level through an explicit stack
+ */
+json_t *jsonCopy(json_t *value)
+{
+    jsonFrame_t local[JSON_FRAME_LOCAL], *stack, *top, *tmp;
+    json_t *rval, *node;
+    int depth, size;
+
+    if(!value) return NULL;
+
+    rval=_jsonCopy(value, false);
+    if(!rval) return NULL;
+    if(rval->type!=JSON_TYPE_ARRAY && rval->type!=JSON_TYPE_OBJECT) return rval;
+
+    stack=local;
+    size=JSON_FRAME_LOCAL;
+
+    stack[0].node=rval;
+    stack[0].tail=NULL;
+    stack[0].src=value->list;
+    stack[0].count=0;
+    depth=1;
+
+    while(depth) {
+        top=&stack[depth-1];
+        if(!top->src) {
+            if(top->count>JSON_INDEX_MIN) _indexBuild(top->node);
+            depth--;
+            continue;
+        }
+
+        node=_jsonCopy(top->src, true);
+        if(!node) goto error;
+
+        if(top->tail) top->tail->next=node;
+        else top->node->list=node;
+        top->tail=node;
+        top->count++;
+
+        if((node->type==JSON_TYPE_ARRAY || node->type==JSON_TYPE_OBJECT) && top->src->list) {
+            if(depth==size) {
+                tmp=_stackGrow(stack, local, &size, sizeof(jsonFrame_t));
+                if(!tmp) goto error;
+                stack=tmp;
+                top=&stack[depth-1];
+            }
+
+            stack[depth].node=node;
+            stack[depth].tail=NULL;
+            stack[depth].src=top->src->list;
+            stack[depth].count=0;
+            depth++;
+        }
+
+        top->src=top->src->next;
+    }
+
+    if(stack!=local) jsonMemFree(stack);
+
+    return rval;
+
+error:
+    if(stack!=local) jsonMemFree(stack);
+    jsonFree(rval);
+
+    return NULL;
+}
+
+/* frees 'value' with its members and the siblings behind it, chains still 
+ * to be freed wait on an explicit stack, which only grows with nesting; 
+ * when it can not, the siblings are chained in front of the members
+ */
+void jsonFree(json_t *value)
+{
+    json_t *local[JSON_FRAME_LOCAL], **stack, **tmp;
+    json_t *next, *last;
+    int depth, size;
+
+    stack=local;
+    size=JSON_FRAME_LOCAL;
+    depth=0;
+
+    while(1) {
+        while(value && !value->fixed) {
+            next=value->next;
+
+            if(value->type==JSON_TYPE_STRING) {
+                if(!value->reference) jsonMemFree(value->string);
+            }
+            else if(value->type==JSON_TYPE_ARRAY|| value->type==JSON_TYPE_OBJECT) {
+                if(!value->reference && value->list) {
+                    // members first, the siblings wait
+                    if(next && depth==size) {
+                        tmp=_stackGrow(stack, local, &size, sizeof(json_t *));
+                        if(tmp) stack=tmp;
+                    }
+                    if(!next || next->fixed) next=value->list;
+                    else if(depth<size) {
+                        stack[depth++]=next;
+                        next=value->list;
+                    }
+                    else {  // out of memory, the members go after the siblings
+                        for(last=next; last->next && !last->next->fixed; last=last->next);
+                        last->next=value->list;
+                    }
+                }
+            }
+
+            if(value->label && !value->refLabel) jsonMemFree(value->label);
+            if((value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) && value->index) jsonMemFree(value->index);
+
+            jsonPoolFree(value, sizeof(json_t));
+            value=next;
+        }
+
+        if(depth==0) break;
+        value=stack[--depth];
+    }
+
+    if(stack!=local) jsonMemFree(stack);
+}
+
+/* jsonFree() of a tree built under a thread allocator (see 
+ * jsonSetThreadAllocator()), from any thread and after that allocator 
+ * was switched off
+ */
+void jsonFreeWith(json_t *value, const jsonAllocator_t *alloc)
+{
+    jsonAllocScope_t scope;
+
+    scope=_scopeEnter(alloc, NULL);
+    jsonFree(value);
+    _scopeLeave(scope);
+}
+
+/**********************
+ **  Path Functions  **
+ **********************/
+/* A compiled path is the jsonQuery() syntax ("a.b[3].c") split into 
+ * segments once, with the key hashes ready for the member index.
+ */
+
+/* parses 'str' into 'seg' and 'keys' or only counts the segments if 'seg' 
+ * is NULL, returns the number of segments or -1 on syntax error
+ */
+int _pathParse(const char *str, jsonPathSeg_t *seg, char *keys)
+{
+    const char *start;
+    int count, n;
+
+    count=0;
+    while(*str!='\0') {
+        if(*str=='[') {
+            str++;
+            n=0;
+            for(start=str; isdigit(*str); str++) {
+                if(str-start>=9) return -1;  // out of int range
+                n=n*10+(*str-'0');
+            }
+            if(str==start || *str!=']') return -1;
+            str++;
+
+            if(seg) {
+                seg[count].key=NULL;
+                seg[count].len=0;
+                seg[count].hash=0;
+                seg[count].index=n;
+            }
+        }
+        else {
+            for(start=str; isalnum(*str); str++);
+            if(*str!='.' && *str!='[' && *str!='\0') return -1;
+
+            if(seg) {
+                seg[count].key=keys;
+                seg[count].len=str-start;
+                seg[count].hash=_jsonHash(start, str-start);
+                seg[count].index=-1;
+
+                memcpy(keys, start, str-start);
+                keys+=str-start;
+                *keys++='\0';
+            }
+        }
+
+        if(*str=='.') str++;
+        count++;
+    }
+
+    return count;
+}
+
+/* first member from 'seg' */
+inline json_t *_pathStep(json_t *value, const jsonPathSeg_t *seg)
+{
+    if(seg->key) {
+        if(value->type!=JSON_TYPE_OBJECT) return NULL;
+        return _objectMember(value, seg->key, seg->hash);
+    }
+
+    if(value->type!=JSON_TYPE_ARRAY) return NULL;
+    return _arrayMember(value, seg->index);
+}
+
+inline bool _pathSegEq(const jsonPathSeg_t *a, const jsonPathSeg_t *b)
+{
+    if(a->key==NULL || b->key==NULL) return a->key==b->key && a->index==b->index;
+
+    return a->hash==b->hash && a->len==b->len && memcmp(a->key, b->key, a->len)==0;
+}
+
+/* resolves paths sel[0..n) below 'value' at segment 'depth', paths sharing 
+ * the next segment are grouped and walk it once
+ */
+void _pathExtract(json_t *value, jsonPath_t **paths, int *sel, int n, int depth, json_t **results)
+{
+    const jsonPathSeg_t *seg;
+    json_t *child;
+    int i, j, group, tmp;
+
+    i=0;
+    while(i<n) {
+        if(paths[sel[i]]->count==depth) {
+            results[sel[i]]=value;
+            i++;
+            continue;
+        }
+
+        // gather the paths going the same way behind sel[i]
+        seg=&paths[sel[i]]->seg[depth];
+        group=i+1;
+        for(j=i+1; j<n; j++) {
+            if(paths[sel[j]]->count>depth && _pathSegEq(seg, &paths[sel[j]]->seg[depth])) {
+                tmp=sel[group];
+                sel[group]=sel[j];
+                sel[j]=tmp;
+                group++;
+            }
+        }
+
+        child=_pathStep(value, seg);
+        if(child) _pathExtract(child, paths, sel+i, group-i, depth+1, results);
+
+        i=group;
+    }
+}
+
+jsonPath_t *jsonPathCompile(const char *str)
+{
+    jsonPath_t *rval;
+    int count;
+
+    if(!str) return NULL;
+
+    count=_pathParse(str, NULL, NULL);
+    if(count<0) return NULL;
+
+    // segments and their keys in one block
+    rval=jsonMemAlloc(sizeof(jsonPath_t)+count*sizeof(jsonPathSeg_t)+strlen(str)+1);
+    if(!rval) return NULL;
+
+    rval->count=_pathParse(str, rval->seg, (char *)(rval->seg+count));
+
+    return rval;
+}
+
+void jsonPathFree(jsonPath_t *path)
+{
+    jsonMemFree(path);
+}
+
+json_t *jsonPathQuery(json_t *root, const jsonPath_t *path)
+{
+    int i;
+
+    if(!root || !path) return NULL;
+
+    for(i=0; i<path->count && root; i++) root=_pathStep(root, &path->seg[i]);
+
+    return root;
+}
+
+/* fills results[i] with the node at paths[i] (NULL if absent) in one walk, 
+ * returns the number of paths found or -1 on error
+ */
+int jsonPathExtract(json_t *root, jsonPath_t **paths, json_t **results, int n)
+{
+    int sel[64], *psel;
+    int i, found;
+
+    if(!root || !paths || !results || n<0) return -1;
+
+    psel=(n<=64)?sel:jsonMemAlloc(n*sizeof(int));
+    if(!psel) return -1;
+
+    for(i=0; i<n; i++) {
+        results[i]=NULL;
+        psel[i]=i;
+    }
+
+    // NULL paths are never found
+    found=0;
+    for(i=0; i<n; i++) {
+        if(paths[i]) psel[found++]=i;
+    }
+    _pathExtract(root, paths, psel, found, 0, results);
+
+    if(psel!=sel) jsonMemFree(psel);
+
+    found=0;
+    for(i=0; i<n; i++) {
+        if(results[i]) found++;
+    }
+
+    return found;
+}
+
+/*****************************
+ **  Push Parser Functions  **
+ *****************************/
+/* The push parser takes the input in chunks of any size: arrays and 
+ * objects are built as their members arrive, with the open ones on a frame 
+ * stack kept in the parser, and only the scalar or label being read is 
+ * carried over to the next chunk.
+ */
+#define JSON_PUSH_VALUE   0  // before a value (or ']' in arrays)
+#define JSON_PUSH_STRING  1  // inside a string or label
+#define JSON_PUSH_SCALAR  2  // inside a number or literal
+#define JSON_PUSH_AFTER   3  // after a member, ',' or the closing expected
+#define JSON_PUSH_LABEL   4  // before a label (or '}' right after '{')
+#define JSON_PUSH_COLON   5  // after a label
+#define JSON_PUSH_ERROR   6
+
+struct jsonParser_t {
+    int state;
+    int error;
+    bool first;        // right after '{', '}' allowed
+    bool isLabel;      // the string read is a label
+    bool escape;       // last byte read inside a string was a '\'
+
+    jsonFrame_t *stack;
+    int depth;
+    int size;
+
+    json_t *root;      // top level container being filled
+    char *label;       // of the member to come
+
+    char *token;       // partial scalar or label
+    size_t tokenLen;
+    size_t tokenSize;
+
+    json_t *head;      // values completed during this feed
+    json_t *tail;
+
+    size_t fed;        // bytes fed since the last reset
+    size_t offset;     // where the error was found
+    int errorDepth;    // and how deeply nested
+    int maxDepth;      // nesting limit
+
+    const jsonAllocator_t *alloc;  // of everything the parser allocates, or NULL
+    jsonAllocStats_t *stats;
+
+    // reused by every jsonParserParse()
+    jsonArena_t *arena;     // nodes, strings and labels of the document
+    jsonScratch_t scratch;  // strings being unescaped
+    char *text;             // terminated copy of the input
+    size_t textSize;
+};
+
+inline bool _pushToken(jsonParser_t *p, const char *src, size_t len)
+{
+    char *tmp;
+    size_t size;
+
+    if(p->tokenLen+len+1>p->tokenSize) {
+        for(size=p->tokenSize?p->tokenSize*2:64; size<p->tokenLen+len+1; size*=2);
+
+        tmp=jsonMemRealloc(p->token, size);
+        if(!tmp) return false;
+        p->token=tmp;
+        p->tokenSize=size;
+    }
+
+    memcpy(p->token+p->tokenLen, src, len);
+    p->tokenLen+=len;
+    p->token[p->tokenLen]='\0';
+
+    return true;
+}
+
+/* links a finished value into the open container or the output */
+inline void _pushAttach(jsonParser_t *p, json_t *value)
+{
+    jsonFrame_t *top;
+
+    if(p->depth==0) {
+        if(p->tail) p->tail->next=value;
+        else p->head=value;
+        p->tail=value;
+
+        p->root=NULL;
+        p->state=JSON_PUSH_VALUE;
+        return;
+    }
+
+    top=&p->stack[p->depth-1];
+    if(p->label) {
+        value->label=p->label;
+        p->label=NULL;
+    }
+
+    if(top->tail) top->tail->next=value;
+    else top->node->list=value;
+    top->tail=value;
+    top->count++;
+
+    p->state=JSON_PUSH_AFTER;
+}
+
+inline bool _pushOpen(jsonParser_t *p, char c)
+{
+    jsonFrame_t *tmp;
+    json_t *node;
+
+    if(p->depth>=p->maxDepth) {
+        p->error=JSON_ERROR_DEPTH;
+        return false;
+    }
+
+    if(p->depth==p->size) {
+        tmp=jsonMemRealloc(p->stack, p->size*2*sizeof(jsonFrame_t));
+        if(!tmp) return false;
+        p->stack=tmp;
+        p->size*=2;
+    }
+
+    node=_newNode(NULL);
+    if(!node) return false;
+    if(c=='[') jsonSetArray(node, NULL);
+    else jsonSetObject(node, NULL);
+
+    // linked into its parent now, emitted at the top level once closed
+    if(p->depth) _pushAttach(p, node);
+    else p->root=node;
+
+    p->stack[p->depth].node=node;
+    p->stack[p->depth].tail=NULL;
+    p->stack[p->depth].count=0;
+    p->depth++;
+
+    p->state=(c=='[')?JSON_PUSH_VALUE:JSON_PUSH_LABEL;
+    p->first=true;
+
+    return true;
+}
+
+inline bool _pushClose(jsonParser_t *p, char c)
+{
+    json_t *node;
+
+    if(p->depth==0) return false;
+
+    node=p->stack[p->depth-1].node;
+    if(c!=(node->type==JSON_TYPE_OBJECT?'}':']')) return false;
+
+    if(p->stack[p->depth-1].count>JSON_INDEX_MIN) _indexBuild(node);
+
+    p->depth--;
+    if(p->depth==0) _pushAttach(p, node);
+    else p->state=JSON_PUSH_AFTER;
+
+    return true;
+}
+
+/* the string or scalar collected in the token is complete */
+inline bool _pushFinish(jsonParser_t *p)
+{
+    json_t *value;
+    char *ptr;
+
+    ptr=p->token;
+
+    if(p->state==JSON_PUSH_STRING) {
+        if(p->isLabel) {
+            p->label=_takeString(&ptr, NULL, false);
+            if(!p->label) return false;
+
+            p->state=JSON_PUSH_COLON;
+            return true;
+        }
+
+        value=_matchString(&ptr, NULL, false);
+    }
+    else value=_matchScalar(&ptr, NULL, false);
+
+    if(!value) return false;
+    if(*ptr!='\0') {
+        // junk glued to the token
+        jsonFree(value);
+        return false;
+    }
+
+    _pushAttach(p, value);
+
+    return true;
+}
+
+/* the parser ran into an error, drops what was partially built */
+inline void _pushFail(jsonParser_t *p)
+{
+    if(!p->error) p->error=(json_error==JSON_ERROR_MEMORY)?JSON_ERROR_MEMORY:JSON_ERRPR_PHRASE;
+    json_error=p->error;
+    p->errorDepth=p->depth;
+
+    if(p->label) jsonMemFree(p->label);
+    p->label=NULL;
+    jsonFree(p->root);
+    p->root=NULL;
+    p->depth=0;
+
+    p->state=JSON_PUSH_ERROR;
+}
+
+jsonParser_t *jsonParserNew(void)
+{
+    return jsonParserNewWith(NULL, NULL);
+}
+
+/* a parser whose calls allocate from 'alloc' and count in 'stats' (NULL 
+ * ones leave the calling thread's in effect), including the values 
+ * jsonParserFeed() returns: those are freed by jsonParserRelease()
+ */
+jsonParser_t *jsonParserNewWith(const jsonAllocator_t *alloc, jsonAllocStats_t *stats)
+{
+    jsonParser_t *rval;
+    jsonAllocScope_t scope;
+
+    scope=_scopeEnter(alloc, stats);
+
+    rval=_memZero(1, sizeof(jsonParser_t));
+    if(rval) {
+        rval->alloc=alloc;
+        rval->stats=stats;
+        rval->maxDepth=_maxDepth();
+        rval->size=JSON_FRAME_LOCAL;
+        rval->stack=jsonMemAlloc(rval->size*sizeof(jsonFrame_t));
+        if(!rval->stack) {
+            jsonMemFree(rval);
+            rval=NULL;
+        }
+    }
+
+    _scopeLeave(scope);
+
+    return rval;
+}
+
+/* back to the beginning of a stream, also clears errors */
+void jsonParserReset(jsonParser_t *p)
+{
+    jsonAllocScope_t scope;
+
+    if(!p) return;
+    scope=_scopeEnter(p->alloc, p->stats);
+
+    if(p->label) jsonMemFree(p->label);
+    p->label=NULL;
+    jsonFree(p->root);
+    p->root=NULL;
+    p->depth=0;
+
+    p->tokenLen=0;
+    p->state=JSON_PUSH_VALUE;
+    p->error=JSON_ERROR_NONE;
+    p->fed=0;
+    p->offset=0;
+    p->errorDepth=0;
+
+    // the document of jsonParserParse() goes, its memory stays
+    _jsonArenaRecycle(p->arena);
+
+    _scopeLeave(scope);
+}
+
+void jsonParserFree(jsonParser_t *p)
+{
+    jsonAllocScope_t scope;
+
+    if(!p) return;
+    scope=_scopeEnter(p->alloc, p->stats);
+
+    jsonParserReset(p);
+    jsonArenaFree(p->arena);
+    jsonMemFree(p->scratch.buf);
+    jsonMemFree(p->text);
+    jsonMemFree(p->token);
+    jsonMemFree(p->stack);
+    jsonMemFree(p);
+
+    _scopeLeave(scope);
+}
+
+/* frees a value jsonParserFeed() returned through the parser's allocator 
+ * and stats, whichever the calling thread has
+ */
+void jsonParserRelease(jsonParser_t *p, json_t *value)
+{
+    jsonAllocScope_t scope;
+
+    if(!p) return;
+
+    scope=_scopeEnter(p->alloc, p->stats);
+    jsonFree(value);
+    _scopeLeave(scope);
+}
+
+/* nesting limit of this parser's parses, the one of jsonSetMaxDepth() at 
+ * the time it was created until then
+ */
+void jsonParserSetMaxDepth(jsonParser_t *p, int depth)
+{
+    if(p) p->maxDepth=(depth>0)?depth:JSON_MAX_DEPTH;
+}
+
+int jsonParserError(jsonParser_t *p)
+{
+    return p?p->error:JSON_ERROR_NONE;
+}
+
+/* byte offset into the input (all chunks fed) where the error was found */
+size_t jsonParserOffset(jsonParser_t *p)
+{
+    return p?p->offset:0;
+}
+
+/* containers open at the error */
+int jsonParserDepth(jsonParser_t *p)
+{
+    return p?p->errorDepth:0;
+}
+
+inline json_t *_parserParse(jsonParser_t *p, const char *buf, size_t len)
+{
+    jsonBuilder_t b;
+    const char *base;
+    char *src;
+    size_t first, last;
+
+    if(!p || !buf) return NULL;
+
+    jsonParserReset(p);
+    if(!p->arena) {
+        p->arena=jsonArenaNew(0);
+        if(!p->arena) return NULL;
+    }
+
+    json_error=JSON_ERROR_NONE;
+    if(_jsonBoundary(buf, len, &first, &last)) {
+        base=buf;
+        src=(char *)buf+first;  // read only, not in situ
+    }
+    else {
+        if(len+1>p->textSize) {
+            src=jsonMemRealloc(p->text, len+1);
+            if(!src) return NULL;
+            p->text=src;
+            p->textSize=len+1;
+        }
+        memcpy(p->text, buf, len);
+        p->text[len]='\0';
+
+        base=p->text;
+        src=p->text;
+        _skipWhitespace(&src);
+    }
+
+    b.arena=p->arena;
+    b.insitu=false;
+    b.keys=NULL;
+    b.maxDepth=p->maxDepth;
+    b.stack=p->stack;   // the push frames, idle here
+    b.size=p->size;
+    b.depth=0;
+    b.root=NULL;
+    b.label=NULL;
+
+    if(!_buildRun(&b, &src, &p->scratch)) {
+        p->error=json_error;
+        p->offset=src-base;
+        p->errorDepth=b.depth;
+    }
+
+    p->stack=b.stack;   // grown or not
+    p->size=b.size;
+
+    return b.root;
+}
+
+/* parses one complete document of 'len' bytes, which needs no NUL 
+ * terminator, with the parser's own buffers: the result lives in the 
+ * parser until its next parse, reset or free and must not be passed to 
+ * jsonFree(); once they have grown to fit the documents seen, parsing 
+ * allocates nothing
+ */
+json_t *jsonParserParse(jsonParser_t *p, const char *buf, size_t len)
+{
+    jsonAllocScope_t scope;
+    json_t *rval;
+
+    if(!p) return NULL;
+
+    scope=_scopeEnter(p->alloc, p->stats);
+    rval=_parserParse(p, buf, len);
+    _scopeLeave(scope);
+
+    return rval;
+}
+
+inline json_t *_parserFeed(jsonParser_t *p, const char *buf, size_t len)
+{
+    const char *start, *end, *ptr;
+    json_t *rval;
+    bool closed;
+    char c;
+
+    if(!p || p->state==JSON_PUSH_ERROR) return NULL;
+
+    p->head=NULL;
+    p->tail=NULL;
+
+    if(!buf || len==0) {
+        // a number or literal at the top level ends with the stream
+        if(p->state==JSON_PUSH_SCALAR && !_pushFinish(p)) _pushFail(p);
+        else if(p->state!=JSON_PUSH_VALUE || p->depth) _pushFail(p);  // truncated
+        if(p->state==JSON_PUSH_ERROR) p->offset=p->fed;
+
+        rval=p->head;
+        p->head=NULL;
+        return rval;
+    }
+
+    start=buf;
+    end=buf+len;
+    while(buf<end && p->state!=JSON_PUSH_ERROR) {
+        c=*buf;
+
+        switch(p->state) {
+            case JSON_PUSH_VALUE:
+                if(_isWhitespace(c)) {
+                    buf++;
+                    break;
+                }
+
+                if(c=='\"') {
+                    p->state=JSON_PUSH_STRING;
+                    p->isLabel=false;
+                    p->escape=false;
+                    p->tokenLen=0;
+                    if(!_pushToken(p, buf++, 1)) _pushFail(p);
+                }
+                else if(c=='[' || c=='{') {
+                    buf++;
+                    if(!_pushOpen(p, c)) _pushFail(p);
+                }
+                else if(c==']') {
+                    // empty array, or a trailing ',' as _buildValue lets pass
+                    buf++;
+                    if(!_pushClose(p, c)) _pushFail(p);
+                }
+                else if(isalnum(c) || c=='-') {
+                    p->state=JSON_PUSH_SCALAR;
+                    p->tokenLen=0;
+                }
+                else _pushFail(p);
+                break;
+
+            case JSON_PUSH_STRING:
+                for(ptr=buf; ptr<end; ptr++) {
+                    if(p->escape) p->escape=false;
+                    else if(*ptr=='\\') p->escape=true;
+                    else if(*ptr=='\"') break;
+                }
+
+                closed=(ptr<end);
+                if(closed) ptr++;   // the closing quote
+
+                if(!_pushToken(p, buf, ptr-buf)) {
+                    _pushFail(p);
+                    break;
+                }
+                buf=ptr;
+                if(closed && !_pushFinish(p)) _pushFail(p);
+                break;
+
+            case JSON_PUSH_SCALAR:
+                for(ptr=buf; ptr<end && (isalnum(*ptr) || *ptr=='-' || *ptr=='+' || *ptr=='.'); ptr++);
+
+                if(!_pushToken(p, buf, ptr-buf)) {
+                    _pushFail(p);
+                    break;
+                }
+                buf=ptr;
+                if(ptr<end && !_pushFinish(p)) _pushFail(p);
+                break;
+
+            case JSON_PUSH_AFTER:
+                if(_isWhitespace(c)) {
+                    buf++;
+                    break;
+                }
+
+                buf++;
+                if(c==',') {
+                    p->state=(p->stack[p->depth-1].node->type==JSON_TYPE_OBJECT)?JSON_PUSH_LABEL:JSON_PUSH_VALUE;
+                    p->first=false;
+                }
+                else if(!_pushClose(p, c)) _pushFail(p);
+                break;
+
+            case JSON_PUSH_LABEL:
+                if(_isWhitespace(c)) {
+                    buf++;
+                    break;
+                }
+
+                buf++;
+                if(c=='\"') {
+                    p->state=JSON_PUSH_STRING;
+                    p->isLabel=true;
+                    p->escape=false;
+                    p->tokenLen=0;
+                    if(!_pushToken(p, buf-1, 1)) _pushFail(p);
+                }
+                else if(c!='}' || !p->first || !_pushClose(p, c)) _pushFail(p);
+                break;
+
+            case JSON_PUSH_COLON:
+                if(_isWhitespace(c)) {
+                    buf++;
+                    break;
+                }
+
+                buf++;
+                if(c==':') p->state=JSON_PUSH_VALUE;
+                else _pushFail(p);
+                break;
+        }
+    }
+
+    if(p->state==JSON_PUSH_ERROR) p->offset=p->fed+(buf-start);
+    p->fed+=len;
+
+    rval=p->head;
+    p->head=NULL;
+
+    return rval;
+}
+
+/* parses the next 'len' bytes of the stream, returns the top level values 
+ * completed by them linked through next (NULL if none), 'len'==0 marks the 
+ * end of the stream; after an error, values completed before it are still 
+ * returned and jsonParserError() tells the error
+ */
+json_t *jsonParserFeed(jsonParser_t *p, const char *buf, size_t len)
+{
+    jsonAllocScope_t scope;
+    json_t *rval;
+
+    if(!p) return NULL;
+
+    scope=_scopeEnter(p->alloc, p->stats);
+    json_error=JSON_ERROR_NONE;
+    rval=_parserFeed(p, buf, len);
+    _scopeLeave(scope);
+
+    return rval;
+}
+
+/**************************
+ **  Document Functions  **
+ **************************/
+/* A document is raw input navigated on demand: the first query builds the 
+ * structural index (_jsonStage1) and paths are then followed from token to 
+ * token, stepping over members by bracket matching on the tokens alone. 
+ * Only the value found is built, into the document's arena. The input is 
+ * not validated beyond what is visited.
+ */
+struct jsonDoc_t {
+    char *json;           // not owned, must outlive the document
+    size_t len;
+    uint32_t *token;      // offsets of the tokens, NULL until needed
+    size_t count;
+    jsonArena_t *arena;   // values built by queries
+    jsonScratch_t scratch;
+};
+
+#define JSON_DOC_FAIL ((size_t)-1)
+
+/* the token behind the value starting at token 'i' */
+inline size_t _docSkip(jsonDoc_t *doc, size_t i)
+{
+    char c;
+    int depth;
+
+    if(i>=doc->count) return JSON_DOC_FAIL;
+
+    c=doc->json[doc->token[i]];
+    if(c!='[' && c!='{') return i+1;
+
+    depth=0;
+    do {
+        if(i>=doc->count) return JSON_DOC_FAIL;
+
+        c=doc->json[doc->token[i++]];
+        if(c=='[' || c=='{') depth++;
+        else if(c==']' || c=='}') depth--;
+    } while(depth>0);
+
+    return i;
+}
+
+/* the token of the member 'seg' of the value at token 'i' */
+size_t _docStep(jsonDoc_t *doc, size_t i, const jsonPathSeg_t *seg)
+{
+    const char *str;
+    char *src;
+    size_t len;
+    bool match;
+    int n;
+
+    // token[count] points at the terminating NUL, which matches nothing
+    if(seg->key) {
+        if(doc->json[doc->token[i]]!='{') return JSON_DOC_FAIL;
+        i++;
+
+        while(doc->json[doc->token[i]]=='\"') {
+            src=doc->json+doc->token[i];
+            if(!_viewString(&src, false, &doc->scratch, &str, &len)) return JSON_DOC_FAIL;
+            match=(len==seg->len && memcmp(str, seg->key, len)==0);
+            i++;
+
+            if(doc->json[doc->token[i]]!=':') return JSON_DOC_FAIL;
+            i++;
+            if(match) return i;   // the first one wins, as in jsonQuery()
+
+            i=_docSkip(doc, i);
+            if(i==JSON_DOC_FAIL || doc->json[doc->token[i]]!=',') return JSON_DOC_FAIL;
+            i++;
+        }
+
+        return JSON_DOC_FAIL;
+    }
+
+    if(doc->json[doc->token[i]]!='[') return JSON_DOC_FAIL;
+    i++;
+
+    for(n=seg->index; n>0; n--) {
+        if(i>=doc->count || doc->json[doc->token[i]]==']') return JSON_DOC_FAIL;
+
+        i=_docSkip(doc, i);
+        if(i==JSON_DOC_FAIL || doc->json[doc->token[i]]!=',') return JSON_DOC_FAIL;
+        i++;
+    }
+    if(i>=doc->count || doc->json[doc->token[i]]==']') return JSON_DOC_FAIL;
+
+    return i;
+}
+
+jsonDoc_t *jsonDocNew(const char *str)
+{
+    jsonDoc_t *rval;
+
+    if(!str) return NULL;
+
+    rval=_memZero(1, sizeof(jsonDoc_t));
+    if(!rval) return NULL;
+
+    rval->arena=jsonArenaNew(0);
+    if(!rval->arena) {
+        jsonMemFree(rval);
+        return NULL;
+    }
+    rval->json=(char *)str;  // read only
+    rval->len=strlen(str);
+
+    return rval;
+}
+
+void jsonDocFree(jsonDoc_t *doc)
+{
+    if(!doc) return;
+
+    jsonArenaFree(doc->arena);
+    jsonMemFree(doc->scratch.buf);
+    jsonMemFree(doc->token);
+    jsonMemFree(doc);
+}
+
+/* releases the values built by earlier queries, the structural index and 
+ * the arena's memory stay for the queries to come
+ */
+void jsonDocReset(jsonDoc_t *doc)
+{
+    if(doc) _jsonArenaRecycle(doc->arena);
+}
+
+/* the value at 'path' built into the document's arena (valid until 
+ * jsonDocReset() or jsonDocFree()), NULL if absent or malformed
+ */
+json_t *jsonDocPathQuery(jsonDoc_t *doc, const jsonPath_t *path)
+{
+    char *src;
+    size_t t;
+    int i;
+
+    if(!doc || !path) return NULL;
+
+    if(!doc->token) {
+        doc->token=_jsonStage1(doc->json, doc->len, &doc->count);
+        if(!doc->token) return NULL;
+    }
+    if(doc->count==0) return NULL;
+
+    t=0;
+    for(i=0; i<path->count; i++) {
+        t=_docStep(doc, t, &path->seg[i]);
+        if(t==JSON_DOC_FAIL) return NULL;
+    }
+
+    src=doc->json+doc->token[t];
+    return _buildValue(&src, doc->arena, false, NULL);
+}
+
+json_t *jsonDocQuery(jsonDoc_t *doc, const char *str)
+{
+    jsonPath_t *path;
+    json_t *rval;
+
+    path=jsonPathCompile(str?str:"");
+    if(!path) return NULL;
+
+    rval=jsonDocPathQuery(doc, path);
+    jsonPathFree(path);
+
+    return rval;
+}
+
+/*****************************
+ **  JSON Lines Functions   **
+ *****************************/
+
+/* newline delimited input is cut into line aligned chunks which a pool of 
+ * workers parses, each worker into its own arena; the values are handed 
+ * to the consumer chunk by chunk, in input order when 'ordered'
+ */
+void *_linesWorker(void *arg)
+{
+    jsonLines_t *lines=arg;
+    jsonLinesChunk_t chunk;
+    jsonLineValue_t *value=NULL, *tmp;
+    jsonArena_t *arena;
+    const char *p, *end, *eol;
+    int i, n, size=0;
+    bool stop;
+
+    _scopeEnter(lines->scope.alloc, lines->scope.stats);
+    arena=jsonArenaNew(0);
+
+    for(;;) {
+        pthread_mutex_lock(&lines->lock);
+        while(lines->queued==0 && !lines->done) pthread_cond_wait(&lines->more, &lines->lock);
+        if(lines->queued==0) {
+            pthread_mutex_unlock(&lines->lock);
+            break;
+        }
+        chunk=lines->queue[lines->head];
+        lines->head=(lines->head+1)%JSON_LINES_QUEUE;
+        lines->queued--;
+        stop=lines->stop;
+        pthread_cond_signal(&lines->room);
+        pthread_mutex_unlock(&lines->lock);
+
+        n=0;
+        for(p=chunk.data, end=p+chunk.len; p<end && !stop && arena; p=eol+1) {
+            eol=memchr(p, '\n', end-p);
+            if(!eol) eol=end;
+
+            while(p<eol && isspace((unsigned char)*p)) p++;
+            if(p==eol) continue;  // blank line
+
+            if(n==size) {
+                tmp=jsonMemRealloc(value, sizeof(jsonLineValue_t)*(size?size*2:256));
+                if(!tmp) break;
+                value=tmp;
+                size=size?size*2:256;
+            }
+            value[n].value=_jsonParseN(p, eol-p, arena);
+            value[n].offset=chunk.offset+(p-chunk.data);
+            n++;
+        }
+
+        pthread_mutex_lock(&lines->lock);
+        if(lines->ordered) {
+            while(lines->deliver!=chunk.seq) pthread_cond_wait(&lines->turn, &lines->lock);
+        }
+        stop=lines->stop;
+        pthread_mutex_unlock(&lines->lock);
+
+        // when ordered, only the worker holding the turn gets here
+        for(i=0; i<n && !stop; i++) {
+            if(!lines->fn(lines->ctx, value[i].value, value[i].offset)) stop=true;
+        }
+
+        pthread_mutex_lock(&lines->lock);
+        lines->count+=i;
+        if(stop) lines->stop=true;
+        if(lines->ordered) {
+            lines->deliver++;
+            pthread_cond_broadcast(&lines->turn);
+        }
+        pthread_mutex_unlock(&lines->lock);
+
+        if(arena) jsonArenaReset(arena);
+        jsonMemFree(chunk.owned);
+    }
+
+    jsonMemFree(value);
+    jsonArenaFree(arena);
+
+    return NULL;
+}
+
+/* queues a chunk, blocking while the queue is full, false once stopped */
+bool _linesQueue(jsonLines_t *lines, const char *data, size_t len, size_t offset, char *owned)
+{
+    jsonLinesChunk_t *chunk;
+
+    pthread_mutex_lock(&lines->lock);
+    while(lines->queued==JSON_LINES_QUEUE && !lines->stop) pthread_cond_wait(&lines->room, &lines->lock);
+    if(lines->stop) {
+        pthread_mutex_unlock(&lines->lock);
+        jsonMemFree(owned);
+        return false;
+    }
+
+    chunk=&lines->queue[(lines->head+lines->queued)%JSON_LINES_QUEUE];
+    chunk->data=data;
+    chunk->len=len;
+    chunk->offset=offset;
+    chunk->seq=lines->seq++;
+    chunk->owned=owned;
+    lines->queued++;
+
+    pthread_cond_signal(&lines->more);
+    pthread_mutex_unlock(&lines->lock);
+
+    return true;
+}
+
+/* runs the workers while 'produce' queues the input, the number of values 
+ * delivered or -1 if the pool could not be started or the input not read
+ */
+int64_t _linesRun(int threads, bool ordered, jsonLineFn_t fn, void *ctx, 
+                  bool (*produce)(jsonLines_t *lines, void *src), void *src)
+{
+    jsonLines_t lines;
+    pthread_t thread[JSON_LINES_THREADS];
+    int i, n;
+    bool fed = false;
+
+    if(!fn) return -1;
+
+    if(threads<=0) threads=sysconf(_SC_NPROCESSORS_ONLN);
+    if(threads<=0) threads=1;
+    if(threads>JSON_LINES_THREADS) threads=JSON_LINES_THREADS;
+
+    _jsonSimdInit();  // before the workers race for it
+
+    memset(&lines, 0, sizeof(jsonLines_t));
+    pthread_mutex_init(&lines.lock, NULL);
+    pthread_cond_init(&lines.more, NULL);
+    pthread_cond_init(&lines.room, NULL);
+    pthread_cond_init(&lines.turn, NULL);
+    lines.ordered=ordered;
+    lines.fn=fn;
+    lines.ctx=ctx;
+    lines.scope.alloc=_jsonThreadAllocator;
+    lines.scope.stats=_jsonStats;
+
+    for(n=0; n<threads; n++) {
+        if(pthread_create(&thread[n], NULL, _linesWorker, &lines)!=0) break;
+    }
+
+    if(n>0) fed=produce(&lines, src);
+
+    pthread_mutex_lock(&lines.lock);
+    if(!fed) lines.stop=true;
+    lines.done=true;
+    pthread_cond_broadcast(&lines.more);
+    pthread_mutex_unlock(&lines.lock);
+
+    for(i=0; i<n; i++) pthread_join(thread[i], NULL);
+
+    pthread_cond_destroy(&lines.turn);
+    pthread_cond_destroy(&lines.room);
+    pthread_cond_destroy(&lines.more);
+    pthread_mutex_destroy(&lines.lock);
+
+    return fed?(int64_t)lines.count:-1;
+}
+
+/* the producers return false if the input could not be read to its end */
+bool _linesProduceBuffer(jsonLines_t *lines, void *src)
+{
+    jsonLinesBuffer_t *in=src;
+    const char *eol;
+    size_t pos, end;
+
+    for(pos=0; pos<in->len; pos=end) {
+        end=pos+JSON_LINES_CHUNK;
+        if(end>=in->len) end=in->len;
+        else {
+            eol=memchr(in->buf+end, '\n', in->len-end);
+            end=eol?(size_t)(eol-in->buf)+1:in->len;
+        }
+        if(!_linesQueue(lines, in->buf+pos, end-pos, pos, NULL)) break;
+    }
+
+    return true;
+}
+
+bool _linesProduceStream(jsonLines_t *lines, void *src)
+{
+    int fd=*(int *)src;
+    char *buf, *carry=NULL, *nl;
+    size_t len, carried=0, size, offset=0;
+    ssize_t got;
+    bool rval = false;
+
+    for(;;) {
+        size=carried+JSON_LINES_CHUNK;
+        buf=jsonMemAlloc(size);
+        if(!buf) break;
+        if(carried) memcpy(buf, carry, carried);
+        len=carried;
+        jsonMemFree(carry);
+        carry=NULL;
+        carried=0;
+
+        while(len<size) {
+            got=read(fd, buf+len, size-len);
+            if(got<0 && errno==EINTR) continue;
+            if(got<=0) break;
+            len+=got;
+        }
+        if(got<0) {
+            json_error=JSON_ERROR_IO;
+            jsonMemFree(buf);
+            break;
+        }
+
+        if(len<size) {  // end of input
+            if(len) _linesQueue(lines, buf, len, offset, buf);
+            else jsonMemFree(buf);
+            rval=true;
+            break;
+        }
+
+        // a partial last line moves to the next chunk
+        for(nl=buf+len-1; nl>=buf && *nl!='\n'; nl--);
+        if(nl>=buf) {
+            carried=len-(nl+1-buf);
+            if(carried) {
+                carry=jsonMemAlloc(carried);
+                if(!carry) {
+                    jsonMemFree(buf);
+                    break;
+                }
+                memcpy(carry, nl+1, carried);
+            }
+            len-=carried;
+        }
+        else {  // a line longer than the chunk keeps growing
+            carry=buf;
+            carried=len;
+            continue;
+        }
+
+        if(!_linesQueue(lines, buf, len, offset, buf)) {  // stopped by the consumer
+            rval=true;
+            break;
+        }
+        offset+=len;
+    }
+
+    jsonMemFree(carry);
+
+    return rval;
+}
+
+/* parses newline delimited JSON with 'threads' workers (0 for one per CPU), 
+ * calling 'fn' for each non-blank line with the value (NULL if the line is 
+ * malformed) and its offset in 'buf'; values are valid only during the 
+ * call. When 'ordered', calls come one at a time in input order, otherwise 
+ * concurrently from the workers, in no particular order. 'fn' returning 
+ * false stops the run. Returns the number of values delivered, -1 on error
+ */
+int64_t jsonLinesParse(const char *buf, size_t len, int threads, bool ordered, jsonLineFn_t fn, void *ctx)
+{
+    jsonLinesBuffer_t in;
+
+    if(!buf) return -1;
+
+    in.buf=buf;
+    in.len=len;
+
+    return _linesRun(threads, ordered, fn, ctx, _linesProduceBuffer, &in);
+}
+
+/* as jsonLinesParse(), reading the descriptor 'fd' until end of file; a 
+ * failed read stops the run with JSON_ERROR_IO (retried on EINTR)
+ */
+int64_t jsonLinesRead(int fd, int threads, bool ordered, jsonLineFn_t fn, void *ctx)
+{
+    if(fd<0) return -1;
+
+    return _linesRun(threads, ordered, fn, ctx, _linesProduceStream, &fd);
+}
+
+/* as jsonLinesParse(), over a read-only memory mapping of 'path' */
+int64_t jsonLinesFile(const char *path, int threads, bool ordered, jsonLineFn_t fn, void *ctx)
+{
+    struct stat st;
+    void *map;
+    int64_t rval;
+    int fd;
+
+    if(!path) return -1;
+
+    fd=open(path, O_RDONLY);
+    if(fd<0) return -1;
+
+    if(fstat(fd, &st)<0) {
+        close(fd);
+        return -1;
+    }
+    if(st.st_size==0) {
+        close(fd);
+        return 0;
+    }
+
+    map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map==MAP_FAILED) return -1;
+
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    rval=jsonLinesParse(map, st.st_size, threads, ordered, fn, ctx);
+
+    munmap(map, st.st_size);
+
+    return rval;
+}
+
+/******************************
+ **  MessagePack Functions   **
+ ******************************/
+
+/* binary encoding of the same trees (msgpack.org): strings and labels are 
+ * length prefixed, numbers are stored big-endian, no text to scan or format
+ */
+inline void _packRaw(jsonWriter_t *w, const void *src, size_t n)
+{
+    if(w->len+n<=w->size) memcpy(&w->buf[w->len], src, n);
+    else if(w->len<w->size) memcpy(&w->buf[w->len], src, w->size-w->len); // truncated output
+    w->len+=n;
+}
+
+/* a type byte followed by 'n' bytes of 'u' */
+inline void _packUint(jsonWriter_t *w, uint8_t c, uint64_t u, int n)
+{
+    uint8_t buf[9];
+    int i;
+
+    buf[0]=c;
+    for(i=n; i>0; i--, u>>=8) buf[i]=(uint8_t)u;
+    _packRaw(w, buf, n+1);
+}
+
+/* header of a string, array or map: the fix form up to 'fixMax', then the 
+ * 8 (strings only), 16 and 32 bit lengths
+ */
+inline void _packLen(jsonWriter_t *w, uint8_t fix, uint32_t fixMax, uint8_t c8, uint8_t c16, size_t n)
+{
+    uint8_t c;
+
+    if(n<=fixMax) {
+        c=fix|(uint8_t)n;
+        _packRaw(w, &c, 1);
+    }
+    else if(c8 && n<=0xff) _packUint(w, c8, n, 1);
+    else if(n<=0xffff) _packUint(w, c16, n, 2);
+    else _packUint(w, c16+1, n, 4);
+}
+
+inline void _packString(jsonWriter_t *w, const char *str)
+{
+    size_t len;
+
+    len=strlen(str);
+    _packLen(w, 0xa0, 31, 0xd9, 0xda, len);
+    _packRaw(w, str, len);
+}
+
+/* a scalar, or the header of an array or object */
+inline void _packNode(json_t *value, jsonWriter_t *w)
+{
+    json_t *ptr;
+    uint64_t u;
+    uint32_t u32;
+    int64_t i;
+    uint8_t c;
+    double d;
+    float f;
+    size_t count;
+
+    switch(value->type) {
+        case JSON_TYPE_NULL:
+            _packRaw(w, "\xc0", 1);
+            break;
+        case JSON_TYPE_BOOLEAN:
+            _packRaw(w, value->boolean ? "\xc3" : "\xc2", 1);
+            break;
+        case JSON_TYPE_STRING:
+            _packString(w, value->string ? value->string : "");
+            break;
+        case JSON_TYPE_INTEGER:
+            i=value->integer;
+            if(i>=-32 && i<=127) {  // fixint
+                c=(uint8_t)i;
+                _packRaw(w, &c, 1);
+            }
+            else if(i>0) {
+                if(i<=0xff) _packUint(w, 0xcc, i, 1);
+                else if(i<=0xffff) _packUint(w, 0xcd, i, 2);
+                else if(i<=0xffffffff) _packUint(w, 0xce, i, 4);
+                else _packUint(w, 0xcf, i, 8);
+            }
+            else if(i>=INT8_MIN) _packUint(w, 0xd0, i, 1);
+            else if(i>=INT16_MIN) _packUint(w, 0xd1, i, 2);
+            else if(i>=INT32_MIN) _packUint(w, 0xd2, i, 4);
+            else _packUint(w, 0xd3, i, 8);
+            break;
+        case JSON_TYPE_NUMERIC:
+            d=value->numeric;
+            f=(float)d;
+            if((double)f==d) {  // exact in single precision
+                memcpy(&u32, &f, 4);
+                _packUint(w, 0xca, u32, 4);
+            }
+            else {
+                memcpy(&u, &d, 8);
+                _packUint(w, 0xcb, u, 8);
+            }
+            break;
+        case JSON_TYPE_ARRAY:
+        case JSON_TYPE_OBJECT:
+            count=0;
+            for(ptr=value->list; ptr; ptr=ptr->next) count++;
+
+            if(value->type==JSON_TYPE_ARRAY) _packLen(w, 0x90, 15, 0, 0xdc, count);
+            else _packLen(w, 0x80, 15, 0, 0xde, count);
+            break;
+    }
+}
+
+/* encodes 'value' without recursion, walking the tree like 
+ * _fillOptStrBuf() does; false if the stack can not grow
+ */
+bool _packValue(json_t *value, jsonWriter_t *w)
+{
+    json_t *local[JSON_FRAME_LOCAL], **stack, **tmp;
+    int depth, size;
+
+    stack=local;
+    size=JSON_FRAME_LOCAL;
+    depth=0;
+
+    while(1) {
+        if((value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) && value->list) {
+            if(depth==size) {
+                tmp=_stackGrow(stack, local, &size, sizeof(json_t *));
+                if(!tmp) goto error;
+                stack=tmp;
+            }
+
+            _packNode(value, w);
+            stack[depth++]=value;
+            value=value->list;
+            if(stack[depth-1]->type==JSON_TYPE_OBJECT) _packString(w, value->label ? value->label : "");
+            continue;
+        }
+        _packNode(value, w);
+
+        while(depth>0 && !value->next) value=stack[--depth];
+        if(depth==0) break;
+
+        value=value->next;
+        if(stack[depth-1]->type==JSON_TYPE_OBJECT) _packString(w, value->label ? value->label : "");
+    }
+
+    if(stack!=local) jsonMemFree(stack);
+
+    return true;
+
+error:
+    if(stack!=local) jsonMemFree(stack);
+
+    return false;
+}
+
+inline uint64_t _unpackUint(const uint8_t *p, int n)
+{
+    uint64_t u=0;
+
+    while(n-->0) u=(u<<8)|*p++;
+
+    return u;
+}
+
+/* walks one value at *src like _saxParse() does on text, without 
+ * recursion; bin is taken as a string, ext types are an error
+ */
+bool _unpackSax(const uint8_t **src, const uint8_t *end, const jsonSax_t *sax, void *ctx, int maxDepth)
+{
+    jsonPackFrame_t local[JSON_FRAME_LOCAL], *stack, *tmp;
+    const uint8_t *p = *src;
+    uint64_t u, n;
+    uint32_t u32;
+    float f;
+    double d;
+    int depth, size, k, shift;
+    uint8_t c;
+    bool ok, open, object, str;
+
+    stack=local;
+    size=JSON_FRAME_LOCAL;
+    depth=0;
+
+#define NEED(x)  if((uint64_t)(end-p)<(uint64_t)(x)) goto error
+
+    while(1) {
+        if(depth>0) {
+            stack[depth-1].count--;
+
+            if(stack[depth-1].object) {  // the label of the next member
+                NEED(1);
+                c=*p++;
+                if((c&0xe0)==0xa0) n=c&0x1f;
+                else if(c>=0xd9 && c<=0xdb) {
+                    k=1<<(c-0xd9);
+                    NEED(k);
+                    n=_unpackUint(p, k);
+                    p+=k;
+                }
+                else goto error;
+
+                NEED(n);
+                if(sax->key && !sax->key(ctx, (const char *)p, n)) goto error;
+                p+=n;
+            }
+        }
+
+        NEED(1);
+        c=*p++;
+        open=str=false;
+        k=0;
+        ok=true;
+
+        if(c<=0x7f) ok=!sax->integer || sax->integer(ctx, c);
+        else if(c>=0xe0) ok=!sax->integer || sax->integer(ctx, (int8_t)c);
+        else if(c<=0x9f) {
+            n=c&0x0f;
+            open=true;
+            object=(c<=0x8f);
+        }
+        else if(c<=0xbf) {
+            n=c&0x1f;
+            str=true;
+        }
+        else switch(c) {
+            case 0xc0:
+                ok=!sax->null || sax->null(ctx);
+                break;
+            case 0xc2:
+            case 0xc3:
+                ok=!sax->boolean || sax->boolean(ctx, c==0xc3);
+                break;
+            case 0xc4: case 0xc5: case 0xc6:  // bin 8/16/32
+                k=1<<(c-0xc4);
+                str=true;
+                break;
+            case 0xd9: case 0xda: case 0xdb:  // str 8/16/32
+                k=1<<(c-0xd9);
+                str=true;
+                break;
+            case 0xca:
+                NEED(4);
+                u32=_unpackUint(p, 4);
+                p+=4;
+                memcpy(&f, &u32, 4);
+                ok=!sax->numeric || sax->numeric(ctx, f);
+                break;
+            case 0xcb:
+                NEED(8);
+                u=_unpackUint(p, 8);
+                p+=8;
+                memcpy(&d, &u, 8);
+                ok=!sax->numeric || sax->numeric(ctx, d);
+                break;
+            case 0xcc: case 0xcd: case 0xce: case 0xcf:  // uint 8..64
+                k=1<<(c-0xcc);
+                NEED(k);
+                u=_unpackUint(p, k);
+                p+=k;
+                if(u>INT64_MAX) ok=!sax->numeric || sax->numeric(ctx, (double)u);
+                else ok=!sax->integer || sax->integer(ctx, (int64_t)u);
+                break;
+            case 0xd0: case 0xd1: case 0xd2: case 0xd3:  // int 8..64
+                k=1<<(c-0xd0);
+                NEED(k);
+                shift=64-8*k;
+                u=_unpackUint(p, k)<<shift;
+                p+=k;
+                ok=!sax->integer || sax->integer(ctx, (int64_t)u>>shift);
+                break;
+            case 0xdc: case 0xdd:  // array 16/32
+            case 0xde: case 0xdf:  // map 16/32
+                k=2<<(c&1);
+                NEED(k);
+                n=_unpackUint(p, k);
+                p+=k;
+                open=true;
+                object=(c>=0xde);
+                break;
+            default:  // ext types and the unused byte
+                goto error;
+        }
+        if(!ok) goto error;
+
+        if(str) {
+            if(k) {
+                NEED(k);
+                n=_unpackUint(p, k);
+                p+=k;
+            }
+            NEED(n);
+            if(sax->string && !sax->string(ctx, (const char *)p, n)) goto error;
+            p+=n;
+        }
+
+        if(open) {
+            if(depth>=maxDepth) {
+                json_error=JSON_ERROR_DEPTH;
+                goto error;
+            }
+            if(depth==size) {
+                tmp=_stackGrow(stack, local, &size, sizeof(jsonPackFrame_t));
+                if(!tmp) goto error;
+                stack=tmp;
+            }
+            if(object) ok=!sax->startObject || sax->startObject(ctx);
+            else ok=!sax->startArray || sax->startArray(ctx);
+            if(!ok) goto error;
+
+            stack[depth].count=n;
+            stack[depth].object=object;
+            depth++;
+        }
+
+        // close the containers this value completed
+        while(depth>0 && stack[depth-1].count==0) {
+            depth--;
+            if(stack[depth].object) ok=!sax->endObject || sax->endObject(ctx);
+            else ok=!sax->endArray || sax->endArray(ctx);
+            if(!ok) goto error;
+        }
+        if(depth==0) break;
+    }
+
+#undef NEED
+
+    *src=p;
+    if(stack!=local) jsonMemFree(stack);
+
+    return true;
+
+error:
+    if(json_error!=JSON_ERROR_DEPTH) json_error=JSON_ERRPR_PHRASE;
+    if(stack!=local) jsonMemFree(stack);
+
+    return false;
+}
+
+json_t *_unpackValue(const uint8_t *buf, size_t len, jsonArena_t *arena)
+{
+    const uint8_t *src = buf;
+    jsonBuilder_t b;
+
+    if(!buf) return NULL;
+
+    b.arena=arena;
+    b.insitu=false;
+    b.keys=NULL;
+    b.maxDepth=_maxDepth();
+    b.stack=b.local;
+    b.size=JSON_FRAME_LOCAL;
+    b.depth=0;
+    b.root=NULL;
+    b.label=NULL;
+
+    json_error=JSON_ERROR_NONE;
+    if(!_unpackSax(&src, buf+len, &_jsonBuilderSax, &b, b.maxDepth) || src!=buf+len) {
+        if(json_error==JSON_ERROR_NONE) json_error=JSON_ERRPR_PHRASE;  // trailing bytes
+        if(b.label && b.label!=b.labelBuf && !arena) jsonMemFree(b.label);
+        if(!arena) jsonFree(b.root);
+        b.root=NULL;
+    }
+
+    if(b.stack!=b.local) jsonMemFree(b.stack);
+
+    return b.root;
+}
+
+/* writes the MessagePack encoding of 'value' into buf (at most size bytes), 
+ * returns the full length like jsonWriteJson(), 0 if out of memory
+ */
+size_t jsonPackWrite(json_t *value, void *buf, size_t size)
+{
+    jsonWriter_t w;
+
+    if(!value) return 0;
+
+    w.buf=buf;
+    w.size=buf ? size : 0;
+    w.len=0;
+    if(!_packValue(value, &w)) return 0;
+
+    return w.len;
+}
+
+/* the MessagePack encoding of 'value' in a new buffer of *len bytes */
+void *jsonPack(json_t *value, size_t *len)
+{
+    void *rval;
+    size_t n;
+
+    if(!value) return NULL;
 
-    n=atoi(buf);
-    accessPtr=value->list;
+    n=jsonPackWrite(value, NULL, 0);
+    if(!n) return NULL;
+    rval=jsonMemAlloc(n);
+    if(!rval) return NULL;
 
-    for(i=0; i<n; i++) {
-        accessPtr=accessPtr->next;
-        if(accessPtr==NULL) break;
+    if(jsonPackWrite(value, rval, n)!=n) {
+        jsonMemFree(rval);
+        return NULL;
     }
+    if(len) *len=n;
 
-    return accessPtr;
+    return rval;
 }
 
-inline json_t *_queryObject(json_t *value, char **src)
+/* decodes exactly 'len' bytes of MessagePack into a tree */
+json_t *jsonUnpack(const void *buf, size_t len)
 {
-    json_t *accessPtr;
-    char buf[256];
-    int i;
-
-    i=0;
-    while(isalnum(**src)) {
-        buf[i++]=**src;
-        (*src)++;
-    }
-    if(**src!='.' && **src!='[' && **src!='\0') return NULL; // syntax error
-    if(**src=='.') (*src)++;
-    buf[i]='\0';
+    return _unpackValue(buf, len, NULL);
+}
 
-    accessPtr=value->list;
+json_t *jsonUnpackInArena(jsonArena_t *arena, const void *buf, size_t len)
+{
+    if(!arena) return NULL;
 
-    while(accessPtr) {
-        if(strcmp(buf, accessPtr->label)==0) break;
-        accessPtr=accessPtr->next;
-    }
-    
-    if(accessPtr) return accessPtr;
-    else return NULL;
+    return _unpackValue(buf, len, arena);
 }
 
-json_t *jsonQuery(json_t *root, const char *str)
+/* walks MessagePack with the callbacks of jsonSaxParse() */
+bool jsonSaxUnpack(const void *buf, size_t len, const jsonSax_t *sax, void *ctx)
 {
-    json_t *currentLevel, *accessPtr;
+    const uint8_t *src = buf;
 
-    if(!root) return NULL;
+    if(!buf || !sax) return false;
 
-    if(!str) return root;
-    if(strlen(str)==0) return root;
+    json_error=JSON_ERROR_NONE;
+    return _unpackSax(&src, src+len, sax, ctx, _maxDepth()) && src==(const uint8_t *)buf+len;
+}
 
-    currentLevel=root;
-    while(*str!='\0') {
-        if(currentLevel->type==JSON_TYPE_ARRAY) accessPtr=_queryArray(currentLevel, (char **)&str);
-        else if(currentLevel->type==JSON_TYPE_OBJECT) accessPtr=_queryObject(currentLevel, (char **)&str);
-        else return NULL;
+/*************************
+ **  Tape Functions     **
+ *************************/
 
-        if(!accessPtr) break; 
-        currentLevel=accessPtr;
-    }
+/* a parsed tree laid out for read-only mapping: node records with file 
+ * offsets instead of pointers, members of a container contiguous (objects 
+ * above JSON_INDEX_MIN followed by their hash slots), strings and labels 
+ * NUL-terminated and deduplicated in a pool at the end of the file
+ */
+/* grows a buffer to hold 'n' more bytes */
+bool _tapeGrow(char **buf, size_t *size, size_t len, size_t n)
+{
+    char *tmp;
+    size_t cap;
 
-    return accessPtr;
+    if(len+n<=*size) return true;
+
+    for(cap=*size?*size:4096; cap<len+n; cap*=2);
+    tmp=jsonMemRealloc(*buf, cap);
+    if(!tmp) return false;
+
+    *buf=tmp;
+    *size=cap;
+
+    return true;
 }
 
-bool jsonEqNull(json_t *value)
+/* zeroed room for records, returns its offset, 0 if out of memory */
+uint64_t _tapeAlloc(jsonTapeWriter_t *t, size_t n)
 {
-    if(!value) return true;
+    uint64_t rval;
 
-    switch(value->type) {
-        case JSON_TYPE_NULL:
-            return true;
-        case JSON_TYPE_STRING:
-            if(strlen(value->string)==0) return true;
-            else return false;
-        case JSON_TYPE_INTEGER:
-            if(value->integer==0) return true;
-            else return false;
-        case JSON_TYPE_NUMERIC:
-            if(value->numeric==0) return true;
-            else return false;
-        case JSON_TYPE_ARRAY:
-        case JSON_TYPE_OBJECT:
-            if(value->list==NULL) return true;
-            else return false;
-        default: // JSON_TYPE_BOOLEAN
-            return false;
-    }
+    n=(n+7)&~(size_t)7;
+    if(!_tapeGrow(&t->area, &t->size, t->len, n)) return 0;
+
+    rval=t->len;
+    memset(t->area+rval, 0, n);
+    t->len+=n;
+
+    return rval;
 }
 
-bool jsonEqBoolean(json_t *value)
+/* pool offset of 'str', added once, (uint64_t)-1 if out of memory */
+uint64_t _tapeString(jsonTapeWriter_t *t, const char *str)
 {
-    if(!value) return false;
+    uint64_t *tmp, off;
+    uint32_t hash;
+    size_t len, i, j, mask;
+
+    len=strlen(str);
+    if(len==0) return 0;
+
+    if(t->dedupCount*2>=t->dedupSize) {  // rehash at half load
+        i=t->dedupSize?t->dedupSize*2:1024;
+        tmp=_memZero(i, sizeof(uint64_t));
+        if(!tmp) return (uint64_t)-1;
+
+        mask=i-1;
+        for(j=0; j<t->dedupSize; j++) {
+            if(!t->dedup[j]) continue;
+            off=t->dedup[j]-1;
+            hash=_jsonHash(t->pool+off, strlen(t->pool+off));
+            for(hash&=mask; tmp[hash]; hash=(hash+1)&mask);
+            tmp[hash]=t->dedup[j];
+        }
+        jsonMemFree(t->dedup);
+        t->dedup=tmp;
+        t->dedupSize=i;
+    }
 
-    switch(value->type) {
-        case JSON_TYPE_BOOLEAN:
-            return value->boolean;
-        case JSON_TYPE_STRING:
-            if(strlen(value->string)) return true;
-            else return false;
-        case JSON_TYPE_INTEGER:
-            if(value->integer) return true;
-            else return false;
-        case JSON_TYPE_NUMERIC:
-            if(value->numeric) return true;
-            else return false;
-        case JSON_TYPE_ARRAY:
-        case JSON_TYPE_OBJECT:
-            if(value->list) return true;
-            else return false;
-        default: // JSON_TYPE_NULL
-            return false;
+    mask=t->dedupSize-1;
+    hash=_jsonHash(str, len);
+    for(i=hash&mask; t->dedup[i]; i=(i+1)&mask) {
+        off=t->dedup[i]-1;
+        if(strcmp(t->pool+off, str)==0) return off;
     }
+
+    if(!_tapeGrow(&t->pool, &t->poolSize, t->poolLen, len+1)) return (uint64_t)-1;
+
+    off=t->poolLen;
+    memcpy(t->pool+off, str, len+1);
+    t->poolLen+=len+1;
+    t->dedup[i]=off+1;
+    t->dedupCount++;
+
+    return off;
 }
 
-int64_t jsonGetInteger(json_t *value)
+/* the record of 'value' at 'rec', member tables are left to the queue */
+bool _tapeFill(jsonTapeWriter_t *t, uint64_t rec, json_t *value, bool label)
 {
-    if(!value) return 0;
+    jsonTapeNode_t *node;
+    uint64_t str = 0, name = 0;
+
+    if(value->type==JSON_TYPE_STRING) {
+        str=_tapeString(t, value->string ? value->string : "");
+        if(str==(uint64_t)-1) return false;
+    }
+    if(label) {
+        name=_tapeString(t, value->label ? value->label : "");
+        if(name==(uint64_t)-1) return false;
+    }
+
+    node=(jsonTapeNode_t *)(t->area+rec);
+    node->type=value->type;
+    node->label=name;
 
     switch(value->type) {
         case JSON_TYPE_BOOLEAN:
-            return (int64_t)value->boolean;
+            node->value=value->boolean;
+            break;
         case JSON_TYPE_STRING:
-            return strtoll(value->string, NULL, 10);
+            node->value=str;
+            node->count=value->string ? strlen(value->string) : 0;
+            break;
         case JSON_TYPE_INTEGER:
-            return value->integer;
+            memcpy(&node->value, &value->integer, 8);
+            break;
         case JSON_TYPE_NUMERIC:
-            return (int64_t)value->numeric;
-        default: // JSON_TYPE_NULL, JSON_TYPE_ARRAY, JSON_TYPE_OBJECT
-            return 0;
+            memcpy(&node->value, &value->numeric, 8);
+            break;
     }
+
+    return true;
 }
 
-double jsonGetNumeric(json_t *value)
+/* objects large enough to be indexed in memory get hash slots on tape */
+inline uint64_t _tapeSlots(const jsonTapeNode_t *node)
 {
-    if(!value) return 0;
+    uint64_t capacity;
 
-    switch(value->type) {
-        case JSON_TYPE_NULL:
-            return 0;
-        case JSON_TYPE_BOOLEAN:
-            if(value->boolean) return 1;
-            else return 0;
-        case JSON_TYPE_STRING:
-            return strtod(value->string, NULL);
-        case JSON_TYPE_INTEGER:
-            return (double)value->integer;
-        case JSON_TYPE_NUMERIC:
-            return value->numeric;
-        default: // JSON_TYPE_ARRAY, JSON_TYPE_OBJECT
-            return NAN;
-    }
+    if(node->type!=JSON_TYPE_OBJECT || node->count<=JSON_INDEX_MIN) return 0;
+
+    for(capacity=16; capacity<=node->count; capacity<<=1);
+    return capacity*2;
 }
 
-inline int _strcpyToJsonEsc(char *dest, char *src)
+/* lays out the tree breadth first, every record is written once */
+bool _tapeLayout(jsonTapeWriter_t *t, json_t *root)
 {
-    int i;
-    int pLen = 0;
+    jsonTapeQueue_t *queue, *tmp;
+    jsonTapeNode_t *node;
+    jsonTapeSlot_t *slot;
+    json_t *value, *ptr;
+    uint64_t table, rec, slots, j;
+    uint32_t count, hash, i;
+    size_t head, tail, size;
+    bool ok = false;
+
+    size=64;
+    queue=jsonMemAlloc(size*sizeof(jsonTapeQueue_t));
+    if(!queue) return false;
+
+    rec=offsetof(jsonTapeHead_t, root);
+    if(!_tapeFill(t, rec, root, false)) goto done;
+    head=0;
+    tail=0;
+    if(root->type==JSON_TYPE_ARRAY || root->type==JSON_TYPE_OBJECT) {
+        queue[tail].rec=rec;
+        queue[tail++].value=root;
+    }
 
-    for(i=0; src[i]!='\0'; i++) {
-        switch(src[i]) {
-            case '\t':
-                dest[pLen++]='\\';
-                dest[pLen++]='t';
-                break;
-            case '\n':
-                dest[pLen++]='\\';
-                dest[pLen++]='n';
-                break;
-            case '\r':
-                dest[pLen++]='\\';
-                dest[pLen++]='r';
-                break;
-            case '\"':
-                dest[pLen++]='\\';
-                dest[pLen++]='\"';
-                break;
-            case '\\':
-                dest[pLen++]='\\';
-                dest[pLen++]='\\';
-                break;
-            default:
-                dest[pLen++]=src[i];
+    while(head<tail) {
+        rec=queue[head].rec;
+        value=queue[head++].value;
+
+        count=0;
+        for(ptr=value->list; ptr; ptr=ptr->next) count++;
+
+        node=(jsonTapeNode_t *)(t->area+rec);
+        node->count=count;
+        slots=_tapeSlots(node);
+
+        table=_tapeAlloc(t, count*sizeof(jsonTapeNode_t)+slots*sizeof(jsonTapeSlot_t));
+        if(!table) goto done;
+        ((jsonTapeNode_t *)(t->area+rec))->value=table;
+
+        for(i=0, ptr=value->list; ptr; i++, ptr=ptr->next) {
+            rec=table+i*sizeof(jsonTapeNode_t);
+            if(!_tapeFill(t, rec, ptr, value->type==JSON_TYPE_OBJECT)) goto done;
+
+            if(ptr->type==JSON_TYPE_ARRAY || ptr->type==JSON_TYPE_OBJECT) {
+                if(tail==size) {
+                    if(head>=size/2) {  // reuse the consumed front
+                        memmove(queue, queue+head, (tail-head)*sizeof(jsonTapeQueue_t));
+                        tail-=head;
+                        head=0;
+                    }
+                    else {
+                        tmp=jsonMemRealloc(queue, size*2*sizeof(jsonTapeQueue_t));
+                        if(!tmp) goto done;
+                        queue=tmp;
+                        size*=2;
+                    }
+                }
+                queue[tail].rec=rec;
+                queue[tail++].value=ptr;
+            }
+
+            if(slots) {
+                node=(jsonTapeNode_t *)(t->area+rec);
+                slot=(jsonTapeSlot_t *)(t->area+table+count*sizeof(jsonTapeNode_t));
+                hash=_jsonHash(t->pool+node->label, strlen(t->pool+node->label));
+                for(j=hash&(slots-1); slot[j].member; j=(j+1)&(slots-1)) {
+                    // duplicated label, the first one wins
+                    if(slot[j].hash==hash && ((jsonTapeNode_t *)(t->area+table))[slot[j].member-1].label==node->label) break;
+                }
+                if(!slot[j].member) {
+                    slot[j].hash=hash;
+                    slot[j].member=i+1;
+                }
+            }
         }
     }
+    ok=true;
 
-    return pLen;
+done:
+    jsonMemFree(queue);
+    return ok;
 }
 
-inline void _fillPureValStrBuf(json_t *value, bool esc, char *buf, int *idx)
+/* writes 'root' as a tape file for jsonTapeOpen() */
+bool jsonTapeSave(json_t *root, const char *path)
 {
-    switch(value->type) {
-        case JSON_TYPE_NULL:
-            (*idx)+=sprintf(&buf[*idx], "null");
-            break;
-        case JSON_TYPE_BOOLEAN:
-            if(value->boolean) (*idx)+=sprintf(&buf[*idx], "true");
-            else (*idx)+=sprintf(&buf[*idx], "false");
-            break;
-        case JSON_TYPE_STRING:
-            if(esc) (*idx)+=_strcpyToJsonEsc(&buf[*idx], value->string);
-            else {
-                strcpy(&buf[*idx], value->string);
-                (*idx)+=strlen(value->string);
-            }
-            break;
-        case JSON_TYPE_INTEGER:
-            (*idx)+=sprintf(&buf[*idx], "%ld", value->integer);
-            break;
-        case JSON_TYPE_NUMERIC:
-            (*idx)+=sprintf(&buf[*idx], "%f", value->numeric);
-            break;
-        default:
-            (*idx)+=sprintf(&buf[*idx], "(type error)");
-    }
-    buf[*idx]='\0';
+    jsonTapeWriter_t t;
+    jsonTapeHead_t *head;
+    bool ok = false;
+    int fd;
+
+    if(!root || !path) return false;
+
+    memset(&t, 0, sizeof(jsonTapeWriter_t));
+    _tapeAlloc(&t, sizeof(jsonTapeHead_t));  // records never start at 0
+    if(!t.area) return false;
+    if(!_tapeGrow(&t.pool, &t.poolSize, 0, 1)) goto done;
+    t.pool[t.poolLen++]='\0';  // the empty string at 0
+
+    if(!_tapeLayout(&t, root)) goto done;
+
+    head=(jsonTapeHead_t *)t.area;
+    memcpy(head->magic, JSON_TAPE_MAGIC, 4);
+    head->order=JSON_TAPE_ORDER;
+    head->pool=t.len;
+    head->poolSize=t.poolLen;
+
+    fd=open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd<0) goto done;
+    ok=(write(fd, t.area, t.len)==(ssize_t)t.len && write(fd, t.pool, t.poolLen)==(ssize_t)t.poolLen);
+    if(close(fd)<0) ok=false;
+
+done:
+    jsonMemFree(t.area);
+    jsonMemFree(t.pool);
+    jsonMemFree(t.dedup);
+
+    return ok;
 }
 
-void _fillOptStrBuf(json_t *value, char *buf, int *idx)
+/* maps a tape written by jsonTapeSave() read-only and shared, NULL if it 
+ * is not a valid tape of this byte order
+ */
+jsonTape_t *jsonTapeOpen(const char *path)
 {
-    int i;
-    json_t *arrayPtr, *objectPtr;
+    const jsonTapeHead_t *head;
+    jsonTape_t *rval;
+    struct stat st;
+    void *map;
+    int fd;
 
-    switch(value->type) {
-        case JSON_TYPE_STRING:
-            buf[(*idx)++]='\"';
-            _fillPureValStrBuf(value, true, buf, idx);
-            buf[(*idx)++]='\"';
-            break;
-        case JSON_TYPE_ARRAY:
-            buf[(*idx)++]='[';
-            arrayPtr=value->list;
-            while(arrayPtr) {
-                buf[(*idx)++]=' '; // for pretty   XD
-                _fillOptStrBuf(arrayPtr, buf, idx);
-                buf[(*idx)++]=',';
-                arrayPtr=arrayPtr->next;
-            }
-            if(value->list) (*idx)--; // not empty array, over-write the last comma
-            buf[(*idx)++]=' '; // for pretty
-            buf[(*idx)++]=']';
-            break;
-        case JSON_TYPE_OBJECT:
-            buf[(*idx)++]='{';
-            objectPtr=value->list;
-            while(objectPtr) {
-                buf[(*idx)++]=' '; // for pretty
-                buf[(*idx)++]='\"';
-                (*idx)+=sprintf(&buf[*idx], "%s", objectPtr->label);
-                buf[(*idx)++]='\"';
-                buf[(*idx)++]=':';
-                buf[(*idx)++]=' '; // for pretty
-                _fillOptStrBuf(objectPtr, buf, idx);
-                buf[(*idx)++]=',';
-                objectPtr=objectPtr->next;
-            }
-            if(value->list) (*idx)--; // not empty object, over-write the last comma
-            buf[(*idx)++]=' '; // for pretty
-            buf[(*idx)++]='}';
-            break;
-        default:
-            _fillPureValStrBuf(value, true, buf, idx);
+    if(!path) return NULL;
+
+    fd=open(path, O_RDONLY);
+    if(fd<0) return NULL;
+
+    if(fstat(fd, &st)<0 || (size_t)st.st_size<sizeof(jsonTapeHead_t)+1) {
+        close(fd);
+        return NULL;
+    }
+
+    map=mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(map==MAP_FAILED) return NULL;
+
+    head=map;
+    if(memcmp(head->magic, JSON_TAPE_MAGIC, 4)!=0 || head->order!=JSON_TAPE_ORDER || 
+       head->pool<sizeof(jsonTapeHead_t) || head->poolSize==0 || 
+       head->pool+head->poolSize!=(uint64_t)st.st_size || ((char *)map)[st.st_size-1]!='\0') {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    rval=jsonMemAlloc(sizeof(jsonTape_t));
+    if(!rval) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    rval->map=map;
+    rval->size=st.st_size;
+    rval->pool=rval->map+head->pool;
+    rval->poolSize=head->poolSize;
+    rval->arena=jsonArenaNew(0);
+    if(!rval->arena) {
+        jsonTapeClose(rval);
+        return NULL;
     }
-    buf[*idx]='\0';
+
+    return rval;
 }
 
-char *jsonGetString(json_t *value)
+void jsonTapeClose(jsonTape_t *tape)
 {
-    char buf[4096];
-    char *rval;
-    int len = 0;
+    if(!tape) return;
 
-    if(!value) return NULL;
+    jsonArenaFree(tape->arena);
+    munmap((void *)tape->map, tape->size);
+    jsonMemFree(tape);
+}
 
-    if(value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) {
-        _fillOptStrBuf(value, buf, &len);
-    }
-    else _fillPureValStrBuf(value, false, buf, &len);
+/* releases the values built by earlier queries, for a tape kept open 
+ * over many lookups; the arena's memory stays for the queries to come
+ */
+void jsonTapeReset(jsonTape_t *tape)
+{
+    if(tape) _jsonArenaRecycle(tape->arena);
+}
+
+/* the member table of a container, NULL if it lies outside the records; 
+ * tables always follow the record of their container, so no walk can loop
+ */
+const jsonTapeNode_t *_tapeTable(jsonTape_t *tape, const jsonTapeNode_t *node)
+{
+    uint64_t size;
 
-    rval=malloc(len+1);
-    strcpy(rval, buf);
+    size=(uint64_t)node->count*sizeof(jsonTapeNode_t)+_tapeSlots(node)*sizeof(jsonTapeSlot_t);
+    if(node->value<=(uint64_t)((const char *)node-tape->map) || (node->value&7) || 
+       node->value+size>(uint64_t)(tape->pool-tape->map)) return NULL;
 
-    return rval;
+    return (const jsonTapeNode_t *)(tape->map+node->value);
 }
 
-int jsonListCount(json_t *value)
+inline const char *_tapeText(jsonTape_t *tape, uint64_t off)
 {
-    int count;
-    json_t *ptr;
+    return (off<tape->poolSize) ? tape->pool+off : "";
+}
 
-    if(!value) return -1;
+const jsonTapeNode_t *_tapeStep(jsonTape_t *tape, const jsonTapeNode_t *node, const jsonPathSeg_t *seg)
+{
+    const jsonTapeNode_t *table;
+    const jsonTapeSlot_t *slot;
+    const char *label;
+    uint64_t slots, i, n;
+
+    if(seg->key) {
+        if(node->type!=JSON_TYPE_OBJECT) return NULL;
+        table=_tapeTable(tape, node);
+        if(!table) return NULL;
+
+        slots=_tapeSlots(node);
+        if(slots) {
+            slot=(const jsonTapeSlot_t *)(table+node->count);
+            // at most every slot once, a damaged tape may have none empty
+            for(i=seg->hash&(slots-1), n=0; n<slots && slot[i].member; i=(i+1)&(slots-1), n++) {
+                if(slot[i].hash!=seg->hash || slot[i].member>node->count) continue;
+                label=_tapeText(tape, table[slot[i].member-1].label);
+                if(strncmp(label, seg->key, seg->len)==0 && label[seg->len]=='\0') return &table[slot[i].member-1];
+            }
+            return NULL;
+        }
 
-    if(value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) {
-        count=0;
-        for(ptr=value->list; ptr!=NULL; ptr=ptr->next) count++;
+        for(i=0; i<node->count; i++) {
+            label=_tapeText(tape, table[i].label);
+            if(strncmp(label, seg->key, seg->len)==0 && label[seg->len]=='\0') return &table[i];
+        }
+        return NULL;
     }
-    return -1;
 
-    return count;
+    if(node->type!=JSON_TYPE_ARRAY || seg->index<0 || (uint32_t)seg->index>=node->count) return NULL;
+    table=_tapeTable(tape, node);
+
+    return table ? &table[seg->index] : NULL;
 }
 
-inline json_t *_jsonCopy(json_t *value, bool expand)
+/* one node of the value, strings and labels refer to the mapping */
+json_t *_tapeNode(jsonTape_t *tape, const jsonTapeNode_t *rec)
 {
     json_t *rval;
 
-    if(!value) return NULL;
+    rval=_newNode(tape->arena);
+    if(!rval) return NULL;
 
-    rval=malloc(sizeof(json_t));
-    memcpy(rval, value, sizeof(json_t));
+    jsonSetNull(rval);
+    switch(rec->type) {
+        case JSON_TYPE_BOOLEAN:
+            jsonSetBoolean(rval, rec->value!=0);
+            break;
+        case JSON_TYPE_STRING:
+            jsonRefString(rval, (char *)_tapeText(tape, rec->value));
+            break;
+        case JSON_TYPE_INTEGER:
+            rval->type=JSON_TYPE_INTEGER;
+            memcpy(&rval->integer, &rec->value, 8);
+            break;
+        case JSON_TYPE_NUMERIC:
+            rval->type=JSON_TYPE_NUMERIC;
+            memcpy(&rval->numeric, &rec->value, 8);
+            break;
+        case JSON_TYPE_ARRAY:
+        case JSON_TYPE_OBJECT:
+            rval->type=rec->type;
+            _listSetArena(rval, tape->arena);
+            break;
+    }
+    rval->fixed=true;
 
-    rval->label=NULL;
-    rval->next=NULL;
+    return rval;
+}
 
-    if(rval->type==JSON_TYPE_STRING) {
-        rval->string=malloc(strlen(value->string)+1);
-        strcpy(rval->string, value->string);
-    }
-    else if(rval->type==JSON_TYPE_ARRAY || rval->type==JSON_TYPE_OBJECT) {
-        rval->list=_jsonCopy(value->list, true);
-    }
+/* builds the value of 'rec' into the tape's arena, breadth first */
+json_t *_tapeBuild(jsonTape_t *tape, const jsonTapeNode_t *rec)
+{
+    jsonTapeQueue_t *queue, *tmp;
+    const jsonTapeNode_t *table;
+    json_t *root, *value, *tail;
+    size_t head, size, n;
+    uint32_t i;
+
+    root=_tapeNode(tape, rec);
+    if(!root || (root->type!=JSON_TYPE_ARRAY && root->type!=JSON_TYPE_OBJECT)) return root;
+
+    size=64;
+    queue=jsonMemAlloc(size*sizeof(jsonTapeQueue_t));
+    if(!queue) return NULL;
+
+    queue[0].node=rec;
+    queue[0].value=root;
+    head=0;
+    n=1;
+
+    while(head<n) {
+        rec=queue[head].node;
+        value=queue[head++].value;
+
+        table=_tapeTable(tape, rec);
+        if(!table) {
+            root=NULL;
+            break;
+        }
 
-    if(expand) {
-        if(value->label) {
-            rval->label=malloc(strlen(value->label)+1);
-            strcpy(rval->label, value->label);
+        tail=NULL;
+        for(i=0; i<rec->count; i++) {
+            tail=(tail ? (tail->next=_tapeNode(tape, &table[i])) : (value->list=_tapeNode(tape, &table[i])));
+            if(!tail) {
+                root=NULL;
+                goto done;
+            }
+            if(value->type==JSON_TYPE_OBJECT) {
+                tail->label=(char *)_tapeText(tape, table[i].label);
+                tail->refLabel=true;
+            }
+
+            if(tail->type==JSON_TYPE_ARRAY || tail->type==JSON_TYPE_OBJECT) {
+                if(n==size) {
+                    if(head>=size/2) {  // reuse the consumed front
+                        memmove(queue, queue+head, (n-head)*sizeof(jsonTapeQueue_t));
+                        n-=head;
+                        head=0;
+                    }
+                    else {
+                        tmp=jsonMemRealloc(queue, size*2*sizeof(jsonTapeQueue_t));
+                        if(!tmp) {
+                            root=NULL;
+                            goto done;
+                        }
+                        queue=tmp;
+                        size*=2;
+                    }
+                }
+                queue[n].node=&table[i];
+                queue[n++].value=tail;
+            }
         }
-        if(value->next) rval->next=_jsonCopy(value->next, true);
+
+        if(rec->count>JSON_INDEX_MIN) _indexBuild(value);
     }
 
-    return rval;
+done:
+    jsonMemFree(queue);
+    return root;
 }
 
-json_t *jsonCopy(json_t *value)
+/* the value at 'path' built into the tape's arena (valid until 
+ * jsonTapeReset() or jsonTapeClose()), strings and labels point into the 
+ * read-only mapping
+ */
+json_t *jsonTapePathQuery(jsonTape_t *tape, const jsonPath_t *path)
 {
-    return _jsonCopy(value, false);
+    const jsonTapeNode_t *node;
+    int i;
+
+    if(!tape || !path) return NULL;
+
+    node=&((const jsonTapeHead_t *)tape->map)->root;
+    for(i=0; i<path->count && node; i++) node=_tapeStep(tape, node, &path->seg[i]);
+    if(!node) return NULL;
+
+    return _tapeBuild(tape, node);
 }
 
-void jsonFree(json_t *value)
+json_t *jsonTapeQuery(jsonTape_t *tape, const char *str)
 {
-    if(!value || value->fixed) return;
+    jsonPath_t *path;
+    json_t *rval;
 
-    if(value->type==JSON_TYPE_STRING) if(!value->reference) free(value->string);
-    else if(value->type==JSON_TYPE_ARRAY|| value->type==JSON_TYPE_OBJECT) {
-        if(!value->reference) jsonFree(value->list);
-    }
+    path=jsonPathCompile(str?str:"");
+    if(!path) return NULL;
 
-    if(value->next) jsonFree(value->next);
-    if(value->label) free(value->label);
+    rval=jsonTapePathQuery(tape, path);
+    jsonPathFree(path);
 
-    free(value);
+    return rval;
 }
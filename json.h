@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -57,14 +58,52 @@ extern "C" {
 #define JSON_TYPE_ARRAY    5
 #define JSON_TYPE_OBJECT   6
 
+#define JSON_INDEX_MIN     8  // larger arrays/objects get a lookup index
+
+#define JSON_MAX_DEPTH   512  // default nesting limit of the parsers
+
+/* room for text inside a node: the string and label of a scalar share 
+ * it, an array/object has the part before its index, each with its NUL
+ */
+#define JSON_INLINE       12
+
 /* error codes */
 #define JSON_ERROR_NONE    0
 #define JSON_ERRPR_PHRASE  1  
+#define JSON_ERROR_DEPTH   2  // nested deeper than the limit
+#define JSON_ERROR_MEMORY  3  // out of memory or over the budget
+#define JSON_ERROR_IO      4  // a read failed, errno tells why
+
+extern __thread int json_error;  // error of the last parse
 
+/* a node is 40 bytes on 64-bit: 16 of flags and inline text (or an index 
+ * pointer), then value, next and label; malloc() hands out the same 48 
+ * byte chunk for 32 and 40, so a smaller node would save memory only in 
+ * an arena while pushing labels and strings over 3 bytes out to a 
+ * separate allocation
+ */
 typedef struct json_t {
-    uint8_t fixed:1;
-    uint8_t reference:1;
-    uint8_t type:6;
+    union {
+        struct {
+            uint8_t fixed:1;
+            uint8_t reference:1;
+            uint8_t refLabel:1;  // label is not owned by the node
+            uint8_t indexed:1;   // filed in its parent's index
+            uint8_t type:4;
+            uint8_t interned:1;  // label comes from a jsonKeys_t
+            uint8_t arenaRef:1;  // arena instead of index below (private)
+            uint8_t labelLen;    // of a label kept in text[]
+            uint8_t stringLen;   // of a string kept in text[]
+            char text[JSON_INLINE];  // short string and label stored in place
+        };
+        struct {
+            uint8_t head[8];
+            union {
+                struct jsonIndex_t *index;  // lookup index of an array/object (private)
+                struct jsonArena_t *arena;  // or the arena of a fixed one without (private)
+            };
+        };
+    };
 
     union {
         bool         boolean;
@@ -78,6 +117,104 @@ typedef struct json_t {
     char *label;
 } json_t;
 
+/* allocator behind every allocation of the library, see jsonSetAllocator(); 
+ * 'usable' tells the size of a block for the counters (NULL: only 
+ * allocations are counted)
+ */
+typedef struct jsonAllocator_t {
+    void *(*malloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *ptr, size_t size);
+    void (*free)(void *ctx, void *ptr);
+    size_t (*usable)(void *ctx, void *ptr);
+    void *ctx;
+} jsonAllocator_t;
+
+/* allocation accounting, see jsonSetAllocStats() */
+typedef struct jsonAllocStats_t {
+    int64_t live;    // bytes held
+    int64_t peak;
+    uint64_t count;  // allocations made
+    int64_t limit;   // budget for live, 0 for none
+} jsonAllocStats_t;
+
+/* arena (bump allocator) for whole-document allocation */
+#define JSON_ARENA_CHUNK   65536
+
+typedef struct jsonArena_t {
+    struct jsonChunk_t *chunk;  // current chunk, linked to the older ones
+    char *ptr;                  // next free byte in current chunk
+    char *end;
+    size_t chunkSize;
+} jsonArena_t;
+
+/* compiled query path, see jsonPathCompile() */
+typedef struct jsonPathSeg_t {
+    char *key;       // object member, NULL for an array position
+    size_t len;
+    uint32_t hash;
+    int index;       // array position
+} jsonPathSeg_t;
+
+typedef struct jsonPath_t {
+    int count;
+    jsonPathSeg_t seg[];
+} jsonPath_t;
+
+/* event callbacks of jsonSaxParse(), returning false stops the parsing */
+typedef struct jsonSax_t {
+    bool (*startObject)(void *ctx);
+    bool (*endObject)(void *ctx);
+    bool (*startArray)(void *ctx);
+    bool (*endArray)(void *ctx);
+    bool (*key)(void *ctx, const char *str, size_t len);
+    bool (*string)(void *ctx, const char *str, size_t len);
+    bool (*integer)(void *ctx, int64_t value);
+    bool (*numeric)(void *ctx, double value);
+    bool (*boolean)(void *ctx, bool value);
+    bool (*null)(void *ctx);
+} jsonSax_t;
+
+/* lazily parsed document, see jsonDocQuery() */
+typedef struct jsonDoc_t jsonDoc_t;
+
+/* incremental parser and reusable parse context, see jsonParserFeed() 
+ * and jsonParserParse()
+ */
+typedef struct jsonParser_t jsonParser_t;
+
+/* interned labels, see jsonParseWithKeys() */
+typedef struct jsonKeys_t jsonKeys_t;
+
+/* mapped tape file, see jsonTapeOpen() */
+typedef struct jsonTape_t jsonTape_t;
+
+/* consumer of jsonLinesParse(), returning false stops the run */
+typedef bool (*jsonLineFn_t)(void *ctx, json_t *value, size_t offset);
+
+/* swapping the global allocator while blocks it made are live is 
+ * undefined: they would be freed by the new one
+ */
+void jsonSetAllocator(const jsonAllocator_t *alloc);
+const jsonAllocator_t *jsonSetThreadAllocator(const jsonAllocator_t *alloc);
+jsonAllocStats_t *jsonSetAllocStats(jsonAllocStats_t *stats);
+void *jsonMemAlloc(size_t size);
+void *jsonMemRealloc(void *ptr, size_t size);
+void jsonMemFree(void *ptr);
+
+jsonArena_t *jsonArenaNew(size_t chunkSize);
+void *jsonArenaAlloc(jsonArena_t *arena, size_t size);
+void jsonArenaReset(jsonArena_t *arena);
+void jsonArenaFree(jsonArena_t *arena);
+
+void *jsonPoolAlloc(size_t size);
+void jsonPoolFree(void *ptr, size_t size);
+void jsonPoolTrim(void);
+
+jsonKeys_t *jsonKeysNew(bool shared);
+void jsonKeysFree(jsonKeys_t *keys);
+size_t jsonKeysCount(jsonKeys_t *keys);
+const char *jsonKeysIntern(jsonKeys_t *keys, const char *str);
+
 bool jsonSetNull(json_t *dst);
 bool jsonSetBoolean(json_t *dst, bool value);
 bool jsonSetString(json_t *dst, const char *value);
@@ -91,21 +228,75 @@ bool jsonSetObject(json_t *dst, json_t *value);
 bool jsonRefObject(json_t *dst, json_t *value);
 
 bool jsonInsertList(json_t *dst, json_t *value);
+bool jsonSpliceList(json_t *dst, json_t *src);
+bool jsonRemoveList(json_t *dst, json_t *value);
 
 bool jsonLabelName(json_t *dst, const char *str);
+bool jsonLabelMember(json_t *dst, json_t *member, const char *str);
 
+void jsonSetMaxDepth(int depth);
+bool jsonSaxParse(const char *str, const jsonSax_t *sax, void *ctx);
 json_t *jsonParse(char *str);
+json_t *jsonParseInArena(jsonArena_t *arena, char *str);
+json_t *jsonParseInSitu(char *str, jsonArena_t *arena);
+json_t *jsonParseWithKeys(char *str, jsonArena_t *arena, jsonKeys_t *keys);
+json_t *jsonParseN(const char *buf, size_t len);
+json_t *jsonParseFile(const char *path);
 json_t *jsonQuery(json_t *root, const char *str);
 
+jsonParser_t *jsonParserNew(void);
+jsonParser_t *jsonParserNewWith(const jsonAllocator_t *alloc, jsonAllocStats_t *stats);
+void jsonParserReset(jsonParser_t *p);
+void jsonParserFree(jsonParser_t *p);
+void jsonParserRelease(jsonParser_t *p, json_t *value);
+void jsonParserSetMaxDepth(jsonParser_t *p, int depth);
+int jsonParserError(jsonParser_t *p);
+size_t jsonParserOffset(jsonParser_t *p);
+int jsonParserDepth(jsonParser_t *p);
+json_t *jsonParserFeed(jsonParser_t *p, const char *buf, size_t len);
+json_t *jsonParserParse(jsonParser_t *p, const char *buf, size_t len);
+
 bool jsonEqNull(json_t *value);
 bool jsonEqBoolean(json_t *value);
 int64_t jsonGetInteger(json_t *value);
 double jsonGetNumeric(json_t *value);
 char *jsonGetString(json_t *value);
+size_t jsonWriteString(json_t *value, char *buf, size_t size);
+size_t jsonWriteJson(json_t *value, char *buf, size_t size);
 int jsonListCount(json_t *value);
+json_t *jsonListAt(json_t *value, int n);
 
 json_t *jsonCopy(json_t *value);
 void jsonFree(json_t *value);
+void jsonFreeWith(json_t *value, const jsonAllocator_t *alloc);
+
+jsonPath_t *jsonPathCompile(const char *str);
+void jsonPathFree(jsonPath_t *path);
+json_t *jsonPathQuery(json_t *root, const jsonPath_t *path);
+int jsonPathExtract(json_t *root, jsonPath_t **paths, json_t **results, int n);
+
+jsonDoc_t *jsonDocNew(const char *str);
+void jsonDocFree(jsonDoc_t *doc);
+void jsonDocReset(jsonDoc_t *doc);
+json_t *jsonDocQuery(jsonDoc_t *doc, const char *str);
+json_t *jsonDocPathQuery(jsonDoc_t *doc, const jsonPath_t *path);
+
+size_t jsonPackWrite(json_t *value, void *buf, size_t size);
+void *jsonPack(json_t *value, size_t *len);
+json_t *jsonUnpack(const void *buf, size_t len);
+json_t *jsonUnpackInArena(jsonArena_t *arena, const void *buf, size_t len);
+bool jsonSaxUnpack(const void *buf, size_t len, const jsonSax_t *sax, void *ctx);
+
+bool jsonTapeSave(json_t *root, const char *path);
+jsonTape_t *jsonTapeOpen(const char *path);
+void jsonTapeClose(jsonTape_t *tape);
+void jsonTapeReset(jsonTape_t *tape);
+json_t *jsonTapeQuery(jsonTape_t *tape, const char *str);
+json_t *jsonTapePathQuery(jsonTape_t *tape, const jsonPath_t *path);
+
+int64_t jsonLinesParse(const char *buf, size_t len, int threads, bool ordered, jsonLineFn_t fn, void *ctx);
+int64_t jsonLinesRead(int fd, int threads, bool ordered, jsonLineFn_t fn, void *ctx);
+int64_t jsonLinesFile(const char *path, int threads, bool ordered, jsonLineFn_t fn, void *ctx);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,797 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <malloc.h>
+#include "json.h"
+
+/* Parser throughput on generated documents. 
+ * Build with "make bench", compare the kernels with "make bench SIMD=0".
+ */
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/* pretty-printed array of small records */
+static char *genPretty(int n)
+{
+	char *buf, *p;
+	int i;
+
+	buf=malloc((size_t)n*160+16);
+	p=buf;
+	p+=sprintf(p, "[\n");
+	for(i=0; i<n; i++) {
+		p+=sprintf(p, "    {\n        \"id\": %d,\n        \"name\": \"record %d\",\n        \"active\": %s,\n        \"tags\": [ \"a\", \"b\" ]\n    }%s\n", 
+		           i, i, (i&1) ? "true" : "false", (i<n-1) ? "," : "");
+	}
+	sprintf(p, "]\n");
+
+	return buf;
+}
+
+/* array of long strings with an occasional escape */
+static char *genStrings(int n, int len)
+{
+	char *buf, *p;
+	int i, j;
+
+	buf=malloc((size_t)n*(len+8)+16);
+	p=buf;
+	*p++='[';
+	for(i=0; i<n; i++) {
+		*p++='\"';
+		for(j=0; j<len; j++) {
+			if(j%100==99) { *p++='\\'; *p++='n'; j++; }
+			else *p++='a'+(j%26);
+		}
+		*p++='\"';
+		if(i<n-1) *p++=',';
+	}
+	*p++=']';
+	*p='\0';
+
+	return buf;
+}
+
+/* telemetry-like array of coordinates and counters */
+static char *genNumbers(int n)
+{
+	char *buf, *p;
+	int i;
+
+	buf=malloc((size_t)n*64+16);
+	p=buf;
+	*p++='[';
+	for(i=0; i<n; i++) {
+		p+=sprintf(p, "%.6f,%.15g,%d%s", (i%3600)*0.1-180.0, (double)i/7.0, i*37, (i<n-1) ? "," : "");
+	}
+	*p++=']';
+	*p='\0';
+
+	return buf;
+}
+
+static void benchParse(const char *name, const char *doc, int rounds)
+{
+	json_t *root;
+	char *copy;
+	size_t len;
+	double t0, t;
+	int i;
+
+	len=strlen(doc);
+	copy=malloc(len+1);
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		memcpy(copy, doc, len+1);
+		root=jsonParse(copy);
+		if(!root) {
+			printf("%-12s parse error\n", name);
+			break;
+		}
+		jsonFree(root);
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s\n", name, (double)len*rounds/t/1e6);
+	free(copy);
+}
+
+static bool countValue(void *ctx)
+{
+	(*(long *)ctx)++;
+	return true;
+}
+
+static bool countString(void *ctx, const char *str, size_t len)
+{
+	(void)str;
+	(void)len;
+	(*(long *)ctx)++;
+	return true;
+}
+
+static bool countInteger(void *ctx, int64_t value)
+{
+	(void)value;
+	(*(long *)ctx)++;
+	return true;
+}
+
+static bool countNumeric(void *ctx, double value)
+{
+	(void)value;
+	(*(long *)ctx)++;
+	return true;
+}
+
+static bool countBoolean(void *ctx, bool value)
+{
+	(void)value;
+	(*(long *)ctx)++;
+	return true;
+}
+
+/* events only, no tree */
+static void benchSax(const char *name, const char *doc, int rounds)
+{
+	jsonSax_t sax = {
+		countValue, NULL, countValue, NULL, countString,
+		countString, countInteger, countNumeric, countBoolean, countValue
+	};
+	size_t len;
+	double t0, t;
+	long events = 0;
+	int i;
+
+	len=strlen(doc);
+
+	t0=now();
+	for(i=0; i<rounds; i++) jsonSaxParse(doc, &sax, &events);
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s (sax, %ld events)\n", name, (double)len*rounds/t/1e6, events/rounds);
+}
+
+/* three fields near the start, the middle and the end, parsed fully then 
+ * queried, against a lazy document
+ */
+static void benchLazy(const char *name, const char *doc, int rounds)
+{
+	const char *paths[3] = { "[10].name", "[10000].id", "[19990].tags[1]" };
+	jsonDoc_t *lazy;
+	json_t *root;
+	char *copy;
+	double t0, tf, tl;
+	long found = 0;
+	int i, j;
+
+	tf=tl=0;
+	for(i=0; i<rounds; i++) {
+		t0=now();
+		copy=strdup(doc);
+		root=jsonParse(copy);
+		for(j=0; j<3; j++) {
+			if(jsonQuery(root, paths[j])) found++;
+		}
+		jsonFree(root);
+		free(copy);
+		tf+=now()-t0;
+
+		t0=now();
+		lazy=jsonDocNew(doc);
+		for(j=0; j<3; j++) {
+			if(jsonDocQuery(lazy, paths[j])) found++;
+		}
+		jsonDocFree(lazy);
+		tl+=now()-t0;
+	}
+
+	printf("%-12s %8.2f ms full %8.2f ms lazy (%ld found)\n", name, tf*1e3/rounds, tl*1e3/rounds, found);
+}
+
+/* through a temporary file, mapped by jsonParseFile() */
+static void benchFile(const char *name, const char *doc, int rounds)
+{
+	char path[] = "/tmp/json_benchXXXXXX";
+	json_t *root;
+	size_t len;
+	double t0, t;
+	int fd, i;
+
+	fd=mkstemp(path);
+	if(fd<0) return;
+
+	len=strlen(doc);
+	if(write(fd, doc, len)!=(ssize_t)len) {
+		close(fd);
+		unlink(path);
+		return;
+	}
+	close(fd);
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		root=jsonParseFile(path);
+		jsonFree(root);
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s (file)\n", name, (double)len*rounds/t/1e6);
+	unlink(path);
+}
+
+/* the same document fed in 4 KiB chunks to the push parser */
+static void benchPush(const char *name, const char *doc, int rounds)
+{
+	jsonParser_t *p;
+	json_t *value;
+	size_t len, off, n;
+	double t0, t;
+	int i;
+
+	len=strlen(doc);
+	p=jsonParserNew();
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		for(off=0; off<len; off+=n) {
+			n=(len-off<4096)?len-off:4096;
+			value=jsonParserFeed(p, doc+off, n);
+			if(value) jsonFree(value);
+		}
+		value=jsonParserFeed(p, NULL, 0);
+		if(value) jsonFree(value);
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s (push, 4K chunks)\n", name, (double)len*rounds/t/1e6);
+	jsonParserFree(p);
+}
+
+/* many small messages: a cold jsonParseN() each against one reused 
+ * parser context
+ */
+static void benchContext(const char *name, int n)
+{
+	jsonParser_t *p;
+	json_t *value;
+	char msg[160];
+	size_t len;
+	double t0, tc, tp;
+	int i;
+
+	len=sprintf(msg, "{\"jsonrpc\":\"2.0\",\"method\":\"subtract\",\"params\":{\"minuend\":42,\"subtrahend\":23,\"note\":\"a\\tb\"},\"id\":1}");
+	p=jsonParserNew();
+
+	t0=now();
+	for(i=0; i<n; i++) {
+		value=jsonParseN(msg, len);
+		jsonFree(value);
+	}
+	tc=now()-t0;
+
+	t0=now();
+	for(i=0; i<n; i++) jsonParserParse(p, msg, len);
+	tp=now()-t0;
+
+	printf("%-12s %8.2f Mmsg/s %8.2f Mmsg/s (context)\n", name, n/tc/1e6, n/tp/1e6);
+	jsonParserFree(p);
+}
+
+/* node churn: blocks of 1000 nodes taken and given back, from malloc() 
+ * against the node pool
+ */
+static void benchPool(const char *name, int rounds)
+{
+	void *node[1000];
+	double t0, tm, tp;
+	int i, j;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		for(j=0; j<1000; j++) node[j]=malloc(sizeof(json_t));
+		for(j=0; j<1000; j++) free(node[j]);
+	}
+	tm=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		for(j=0; j<1000; j++) node[j]=jsonPoolAlloc(sizeof(json_t));
+		for(j=0; j<1000; j++) jsonPoolFree(node[j], sizeof(json_t));
+	}
+	tp=now()-t0;
+
+	printf("%-12s %8.1f Mnodes/s %8.1f Mnodes/s (pool)\n", name, rounds*1e3/tm/1e6, rounds*1e3/tp/1e6);
+}
+
+/* what a document costs as the allocation stats see it, and the parse 
+ * rate with and without them counting
+ */
+static void benchAccount(const char *name, const char *doc, int rounds)
+{
+	jsonAllocStats_t stats;
+	json_t *root;
+	size_t len;
+	double t0, tp, ts;
+	int i;
+
+	len=strlen(doc);
+
+	memset(&stats, 0, sizeof(stats));
+	jsonSetAllocStats(&stats);
+	root=jsonParseN(doc, len);
+	printf("%-12s %8.1f KB peak %8llu allocs (accounting)\n", name, stats.peak/1e3, (unsigned long long)stats.count);
+	jsonFree(root);
+
+	t0=now();
+	for(i=0; i<rounds; i++) jsonFree(jsonParseN(doc, len));
+	ts=now()-t0;
+	jsonSetAllocStats(NULL);
+
+	t0=now();
+	for(i=0; i<rounds; i++) jsonFree(jsonParseN(doc, len));
+	tp=now()-t0;
+
+	printf("%-12s %8.1f MB/s %8.1f MB/s (counted)\n", name, (double)len*rounds/tp/1e6, (double)len*rounds/ts/1e6);
+}
+
+static void benchSerialize(const char *name, const char *doc, int rounds)
+{
+	json_t *root;
+	char *copy, *out;
+	size_t len = 0;
+	double t0, t;
+	int i;
+
+	copy=strdup(doc);
+	root=jsonParse(copy);
+	free(copy);
+	if(!root) return;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		out=jsonGetString(root);
+		len=strlen(out);
+		free(out);
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s (serialize)\n", name, (double)len*rounds/t/1e6);
+	jsonFree(root);
+}
+
+/* records with the same ten keys, heap bytes and parse rate with the labels 
+ * copied per member against interned once
+ */
+static char *genRecords(int n)
+{
+	char *buf, *p;
+	int i;
+
+	buf=malloc((size_t)n*256+16);
+	p=buf;
+	*p++='[';
+	for(i=0; i<n; i++) {
+		p+=sprintf(p, "{\"identifier\":%d,\"firstName\":\"a\",\"lastName\":\"b\",\"emailAddress\":\"c\",\"isActive\":true,"
+		              "\"accountBalance\":%d.5,\"registeredAt\":%d,\"countryCode\":\"TW\",\"loginCount\":%d,\"lastSeen\":null}%s", 
+		           i, i, i, i&255, (i<n-1) ? "," : "");
+	}
+	*p++=']';
+	*p='\0';
+
+	return buf;
+}
+
+static void benchKeys(const char *name, const char *doc, int rounds)
+{
+	jsonKeys_t *keys;
+	json_t *root;
+	char *copy;
+	size_t base, plain, interned;
+	double t0, tp, tk;
+	int i;
+
+	keys=jsonKeysNew(false);
+
+	copy=strdup(doc);
+	base=mallinfo2().uordblks;
+	root=jsonParse(copy);
+	plain=mallinfo2().uordblks-base;
+	jsonFree(root);
+	free(copy);
+
+	copy=strdup(doc);
+	base=mallinfo2().uordblks;
+	root=jsonParseWithKeys(copy, NULL, keys);
+	interned=mallinfo2().uordblks-base;
+	jsonFree(root);
+	free(copy);
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		copy=strdup(doc);
+		root=jsonParse(copy);
+		jsonFree(root);
+		free(copy);
+	}
+	tp=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		copy=strdup(doc);
+		root=jsonParseWithKeys(copy, NULL, keys);
+		jsonFree(root);
+		free(copy);
+	}
+	tk=now()-t0;
+
+	printf("%-12s %8.1f MB heap %8.1f MB heap (keys)\n", name, plain/1e6, interned/1e6);
+	printf("%-12s %8.1f MB/s %8.1f MB/s (keys)\n", name, strlen(doc)*rounds/tp/1e6, strlen(doc)*rounds/tk/1e6);
+
+	jsonKeysFree(keys);
+}
+
+/* heap held by a parsed document, per node and against the text size */
+static size_t countNodes(json_t *value)
+{
+	size_t n = 0;
+
+	for(; value; value=value->next) {
+		n++;
+		if(value->type==JSON_TYPE_ARRAY || value->type==JSON_TYPE_OBJECT) n+=countNodes(value->list);
+	}
+
+	return n;
+}
+
+static void benchMemory(const char *name, const char *doc)
+{
+	json_t *root;
+	char *copy;
+	size_t base, heap, nodes;
+
+	copy=strdup(doc);
+	base=mallinfo2().uordblks;
+	root=jsonParse(copy);
+	heap=mallinfo2().uordblks-base;
+	nodes=countNodes(root);
+
+	printf("%-12s %8.1f MB heap %8.1f B/node %6.2fx text (memory)\n", name, heap/1e6, (double)heap/nodes, (double)heap/strlen(doc));
+
+	jsonFree(root);
+	free(copy);
+}
+
+/* reloading a document: parsing the file against mapping a saved tape */
+static void benchTape(const char *name, const char *doc, int rounds)
+{
+	char path[] = "/tmp/json_benchXXXXXX", tape[64];
+	jsonTape_t *t;
+	json_t *root;
+	double t0, tp, tt;
+	size_t len;
+	int fd, i;
+
+	fd=mkstemp(path);
+	if(fd<0) return;
+
+	len=strlen(doc);
+	if(write(fd, doc, len)!=(ssize_t)len) {
+		close(fd);
+		unlink(path);
+		return;
+	}
+	close(fd);
+
+	snprintf(tape, sizeof(tape), "%s.tape", path);
+	root=jsonParseFile(path);
+	jsonTapeSave(root, tape);
+	jsonFree(root);
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		root=jsonParseFile(path);
+		jsonQuery(root, "[10000].name");
+		jsonFree(root);
+	}
+	tp=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		t=jsonTapeOpen(tape);
+		jsonTapeQuery(t, "[10000].name");
+		jsonTapeClose(t);
+	}
+	tt=now()-t0;
+
+	printf("%-12s %8.3f ms parse+query %8.3f ms open+query (tape)\n", name, tp*1e3/rounds, tt*1e3/rounds);
+	unlink(tape);
+	unlink(path);
+}
+
+/* text against MessagePack on the same tree, rates are documents per second */
+static void benchPack(const char *name, const char *doc, int rounds)
+{
+	json_t *root, *value;
+	char *copy, *text;
+	void *pack;
+	size_t tlen, plen;
+	double t0, ts, tp, tu, tq;
+	int i;
+
+	copy=strdup(doc);
+	root=jsonParse(copy);
+	free(copy);
+	if(!root) return;
+
+	text=jsonGetString(root);
+	tlen=strlen(text);
+	pack=jsonPack(root, &plen);
+
+	t0=now();
+	for(i=0; i<rounds; i++) free(jsonGetString(root));
+	ts=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) free(jsonPack(root, NULL));
+	tp=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		copy=strdup(text);
+		value=jsonParse(copy);
+		jsonFree(value);
+		free(copy);
+	}
+	tq=now()-t0;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		value=jsonUnpack(pack, plen);
+		jsonFree(value);
+	}
+	tu=now()-t0;
+
+	printf("%-12s %8zu bytes text %8zu bytes pack\n", name, tlen, plen);
+	printf("%-12s %8.1f /s jsonGetString %8.1f /s jsonPack\n", name, rounds/ts, rounds/tp);
+	printf("%-12s %8.1f /s jsonParse %8.1f /s jsonUnpack\n", name, rounds/tq, rounds/tu);
+
+	free(pack);
+	free(text);
+	jsonFree(root);
+}
+
+static char *genWide(int n)
+{
+	char *doc, *p;
+	int i;
+
+	doc=malloc((size_t)n*32+16);
+	p=doc;
+	*p++='{';
+	for(i=0; i<n; i++) p+=sprintf(p, "%s\"key%d\": %d", i?", ":"", i, i);
+	*p++='}';
+	*p='\0';
+
+	return doc;
+}
+
+static void benchQuery(const char *name, const char *doc, int n, int rounds)
+{
+	json_t *root;
+	jsonPath_t **paths;
+	char *copy, key[32];
+	double t0, t;
+	long found = 0;
+	int i, j;
+
+	copy=strdup(doc);
+	root=jsonParse(copy);
+	free(copy);
+	if(!root) return;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		for(j=0; j<n; j++) {
+			sprintf(key, "key%d", j);
+			if(jsonQuery(root, key)) found++;
+		}
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f Mlookups/s (%ld found)\n", name, (double)n*rounds/t/1e6, found);
+
+	paths=malloc(n*sizeof(jsonPath_t *));
+	for(j=0; j<n; j++) {
+		sprintf(key, "key%d", j);
+		paths[j]=jsonPathCompile(key);
+	}
+
+	found=0;
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		for(j=0; j<n; j++) {
+			if(jsonPathQuery(root, paths[j])) found++;
+		}
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f Mlookups/s (%ld found, compiled)\n", name, (double)n*rounds/t/1e6, found);
+
+	for(j=0; j<n; j++) jsonPathFree(paths[j]);
+	free(paths);
+	jsonFree(root);
+}
+
+static void benchBuild(const char *name, int n, int rounds)
+{
+	json_t *root, *item;
+	double t0, t;
+	int i, j;
+
+	t0=now();
+	for(i=0; i<rounds; i++) {
+		root=malloc(sizeof(json_t));
+		jsonSetArray(root, NULL);
+		for(j=0; j<n; j++) {
+			item=malloc(sizeof(json_t));
+			jsonSetInteger(item, j);
+			jsonInsertList(root, item);
+		}
+		if(jsonListCount(root)!=n) printf("%s: bad count\n", name);
+		jsonFree(root);
+	}
+	t=now()-t0;
+
+	printf("%-12s %8.1f Minserts/s\n", name, (double)n*rounds/t/1e6);
+}
+
+static char *genDeep(int n)
+{
+	char *doc;
+	int i;
+
+	doc=malloc((size_t)n*2+1);
+	for(i=0; i<n; i++) {
+		doc[i]='[';
+		doc[2*n-1-i]=']';
+	}
+	doc[2*n]='\0';
+
+	return doc;
+}
+
+static void benchCopyFree(const char *name, const char *doc, int rounds)
+{
+	json_t *root, *copy;
+	char *str;
+	double t0, tc, tf;
+	int i;
+
+	str=strdup(doc);
+	root=jsonParse(str);
+	free(str);
+	if(!root) return;
+
+	tc=tf=0;
+	for(i=0; i<rounds; i++) {
+		t0=now();
+		copy=jsonCopy(root);
+		tc+=now()-t0;
+
+		t0=now();
+		jsonFree(copy);
+		tf+=now()-t0;
+	}
+
+	printf("%-12s %8.1f ms copy %8.1f ms free\n", name, tc*1e3/rounds, tf*1e3/rounds);
+	jsonFree(root);
+}
+
+/* newline delimited request log */
+static char *genLines(int n)
+{
+	char *buf, *p;
+	int i;
+
+	buf=malloc((size_t)n*128+16);
+	p=buf;
+	for(i=0; i<n; i++) {
+		p+=sprintf(p, "{\"jsonrpc\":\"2.0\",\"method\":\"update\",\"params\":{\"id\":%d,\"value\":%.6f,\"tags\":[\"a\",\"b\"]},\"id\":%d}\n", 
+		           i, i*0.25, i);
+	}
+	*p='\0';
+
+	return buf;
+}
+
+static bool countLine(void *ctx, json_t *value, size_t offset)
+{
+	return value!=NULL;
+}
+
+static void benchLines(const char *name, const char *doc, int rounds)
+{
+	size_t len;
+	double t0, t;
+	int i, threads;
+
+	len=strlen(doc);
+	for(threads=1; threads<=8; threads*=2) {
+		t0=now();
+		for(i=0; i<rounds; i++) jsonLinesParse(doc, len, threads, false, countLine, NULL);
+		t=now()-t0;
+
+		printf("%-12s %8.1f MB/s (%d threads)\n", name, (double)len*rounds/t/1e6, threads);
+	}
+
+	t0=now();
+	for(i=0; i<rounds; i++) jsonLinesParse(doc, len, 0, true, countLine, NULL);
+	t=now()-t0;
+
+	printf("%-12s %8.1f MB/s (ordered)\n", name, (double)len*rounds/t/1e6);
+}
+
+int main(void)
+{
+	char *doc;
+
+	doc=genPretty(20000);
+	benchParse("pretty", doc, 20);
+	benchPush("pretty", doc, 20);
+	benchSax("pretty", doc, 20);
+	benchLazy("pretty", doc, 20);
+	benchFile("pretty", doc, 20);
+	benchPack("pretty", doc, 20);
+	benchTape("pretty", doc, 20);
+	benchMemory("pretty", doc);
+	benchAccount("pretty", doc, 20);
+	free(doc);
+
+	doc=genStrings(2000, 4000);
+	benchParse("strings", doc, 20);
+	free(doc);
+
+	doc=genNumbers(20000);
+	benchParse("numbers", doc, 100);
+	benchSerialize("numbers", doc, 100);
+	benchPack("numbers", doc, 100);
+	free(doc);
+
+	doc=genWide(1000);
+	benchQuery("wide", doc, 1000, 100);
+	free(doc);
+
+	benchBuild("build", 20000, 10);
+	benchContext("messages", 1000000);
+	benchPool("nodes", 10000);
+
+	doc=genRecords(100000);
+	benchKeys("records", doc, 5);
+	benchMemory("records", doc);
+	free(doc);
+
+	doc=genNumbers(333334);  // 1M members
+	benchCopyFree("flat 1M", doc, 5);
+	free(doc);
+
+	jsonSetMaxDepth(100000);
+	doc=genDeep(100000);
+	benchCopyFree("deep 100k", doc, 5);
+	free(doc);
+
+	doc=genLines(200000);
+	benchLines("lines", doc, 5);
+	free(doc);
+
+	return 0;
+}
@@ -0,0 +1,927 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "json.h"
+
+/* Regression checks run by "make test". Inputs come from a fixed seed, so
+ * every run sees the same documents; the digest printed last covers what
+ * the parsers made of them and must not change between the scalar, SSE2
+ * and AVX2 builds.
+ */
+
+static int checks, failures;
+static uint64_t digest = 14695981039346656037ull;  // FNV-1a
+static uint64_t seed = 88172645463325252ull;
+
+static void check(bool ok, const char *what, const char *input)
+{
+	__atomic_add_fetch(&checks, 1, __ATOMIC_RELAXED);
+	if(ok) return;
+
+	if(__atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED)<=20) printf("FAIL %s: %.200s\n", what, input);
+}
+
+static void mix(const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t i;
+
+	for(i=0; i<len; i++) {
+		digest^=p[i];
+		digest*=1099511628211ull;
+	}
+}
+
+static uint64_t rnd(void)
+{
+	seed^=seed<<13;
+	seed^=seed>>7;
+	seed^=seed<<17;
+
+	return seed;
+}
+
+/* integers of every magnitude */
+static int64_t rndInt(void)
+{
+	int64_t n = (int64_t)rnd();
+
+	return n>>(rnd()%64);
+}
+
+/* 'n' scaled down by up to 2^'scale' */
+static double rndReal(int64_t n, int scale)
+{
+	return (double)n/(double)(1ull<<(rnd()%scale));
+}
+
+/* JSON text of a value, NULL for none */
+static char *text(json_t *value)
+{
+	char *buf;
+	size_t len;
+
+	if(!value) return NULL;
+
+	len=jsonWriteJson(value, NULL, 0);
+	buf=malloc(len+1);
+	jsonWriteJson(value, buf, len+1);
+
+	return buf;
+}
+
+static bool same(const char *a, const char *b)
+{
+	if(!a || !b) return a==b;
+
+	return strcmp(a, b)==0;
+}
+
+/* parses a private copy, the parsers may not read past the NUL */
+static json_t *parse(const char *str)
+{
+	char *copy;
+	json_t *rval;
+
+	copy=strdup(str);
+	rval=jsonParse(copy);
+	free(copy);
+
+	return rval;
+}
+
+static void mixParse(const char *str)
+{
+	json_t *value;
+	char *out;
+
+	value=parse(str);
+	out=text(value);
+	if(out) mix(out, strlen(out));
+	mix(&json_error, sizeof(json_error));
+	free(out);
+	jsonFree(value);
+}
+
+/* whitespace runs and strings of every length around the SIMD block
+ * sizes, with an escape or a multibyte character at every position
+ */
+static void testScan(void)
+{
+	static const char *special[]={ "\\n", "\\\"", "\\\\", "\\/", "\\t", "\xc3\xa9", "\xe2\x82\xac" };
+	static const char *decoded[]={ "\n", "\"", "\\", "/", "\t", "\xc3\xa9", "\xe2\x82\xac" };
+	static const char space[]=" \t\n\r";
+	char input[256], expect[256], *p, *e;
+	json_t *value, *item;
+	int len, pos, s, i;
+
+	for(len=0; len<80; len++) {
+		for(pos=0; pos<=len; pos++) {
+			for(s=0; s<(int)(sizeof(special)/sizeof(special[0])); s++) {
+				p=input;
+				e=expect;
+				*p++='[';
+				for(i=0; i<(len+s)%70; i++) *p++=space[(i+pos)%4];
+				*p++='\"';
+				for(i=0; i<pos; i++) *p++=*e++='a'+i%26;
+				p+=sprintf(p, "%s", special[s]);
+				e+=sprintf(e, "%s", decoded[s]);
+				for(i=pos; i<len; i++) *p++=*e++='A'+i%26;
+				*p++='\"';
+				for(i=0; i<pos%40; i++) *p++=space[i%4];
+				*p++=']';
+				*p='\0';
+				*e='\0';
+
+				value=parse(input);
+				item=jsonListAt(value, 0);
+				check(item && item->type==JSON_TYPE_STRING && strcmp(item->string, expect)==0, "scan", input);
+				mixParse(input);
+				jsonFree(value);
+
+				// unterminated at every length
+				input[strlen(input)-pos%3-1]='\0';
+				mixParse(input);
+			}
+		}
+	}
+}
+
+/* random edits of valid documents, only the digest tells */
+static void testMangle(void)
+{
+	static const char *base[]={
+		"{\"name\":\"record 1\",\"tags\":[\"a\",\"b\"],\"active\":true,\"score\":-1.5e3,\"none\":null}",
+		"[ 1 , 2.25 , \"x\\\"y\" , { \"k\" : [ [ ] , { } ] } , false ]",
+		"  {\"a\\u0041b\":\"\xc3\xa9t\xc3\xa9 \\t \\\\\",\"long\":\"0123456789abcdef0123456789abcdef0123456789abcdef\"}  ",
+	};
+	static const char edit[]="{}[]\":,\\ \t\n0aeE-+.tfn\x01\x7f\xc3";
+	char input[256];
+	size_t len, at;
+	int b, n, k;
+
+	for(b=0; b<(int)(sizeof(base)/sizeof(base[0])); b++) {
+		for(n=0; n<4000; n++) {
+			strcpy(input, base[b]);
+			len=strlen(input);
+			for(k=rnd()%3; k>=0; k--) {
+				at=rnd()%len;
+				input[at]=edit[rnd()%(sizeof(edit)-1)];
+			}
+			mixParse(input);
+		}
+	}
+}
+
+/* one number against strtod()/strtoll(), bit for bit */
+static void checkNumber(const char *str)
+{
+	json_t *value;
+	long long integer;
+	double expect;
+	bool plain;
+
+	value=parse(str);
+	plain=!strpbrk(str, ".eE");
+	errno=0;
+	integer=strtoll(str, NULL, 10);
+
+	if(plain && errno!=ERANGE) {
+		check(value && value->type==JSON_TYPE_INTEGER && value->integer==integer, "integer", str);
+	}
+	else {
+		expect=strtod(str, NULL);
+		check(value && value->type==JSON_TYPE_NUMERIC && memcmp(&value->numeric, &expect, sizeof(double))==0, "number", str);
+	}
+	jsonFree(value);
+}
+
+/* the fast paths (exact, Eisel-Lemire, truncated mantissas) and the 
+ * edges where they hand over to strtod()
+ */
+static void testNumbers(void)
+{
+	static const char *edge[]={
+		"0", "-0", "0.0", "-0.0", "1", "-1", "1.5", "0.1", "0.3", "1e0", "1E+2", "1e-2",
+		"9223372036854775807", "-9223372036854775808", "9223372036854775808", "-9223372036854775809",
+		"18446744073709551615", "18446744073709551616", "123456789012345678901234567890",
+		"9007199254740992", "9007199254740993", "9007199254740993.0", "9007199254740993e0",
+		"1e22", "1e23", "1e-22", "1e-23", "8.98846567431158e307", "1.7976931348623157e308",
+		"1.7976931348623158e308", "1.7976931348623159e308", "1e308", "1e309", "-1e400",
+		"2.2250738585072011e-308", "2.2250738585072012e-308", "2.2250738585072014e-308",
+		"4.9406564584124654e-324", "5e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+		"1e-400", "0.000000000000000000000000000000000000000000001",
+		"7.2057594037927933e16", "3.0517578125e-05", "0.1000000000000000055511151231257827",
+		"0.10000000000000000555111512312578270211815834045410156250000000001",
+		"1.00000000000000011102230246251565404236316680908203125",
+		"1.00000000000000011102230246251565404236316680908203124",
+		"1.00000000000000011102230246251565404236316680908203126",
+		"1438456663141390273526118207642235581183227845246331231162636653790368152091394196930365828634687637948157940776599182791387527135353034738357134110310609455693900824193549772792016543182680519740580354365467985440183598701312257624545562331397018329928613196125590274187720073914818062530830316533158098624984118889298281371812288789537310599037529113415438738954894752124724983067241108764488346454376699018673078404751121414804937224240805993123816932326223683090770561597570457793932985826162604255884529134126396282202126526253389383421806727954588525596114379801269094096329805054803089299736996870951258573010877404407451953846698609198213926882692078557033228265259540337077010721400000000000000000000000000000000e-1000",
+		"0e99999999", "1e-99999999",
+	};
+	static const char *malformed[]={ "1.", ".5", "-", "1e", "1e+", "+1", "-.1", "1.e5" };
+	json_t *value;
+	char input[80], *p;
+	int i, n, digits;
+
+	for(i=0; i<(int)(sizeof(edge)/sizeof(edge[0])); i++) checkNumber(edge[i]);
+
+	for(i=0; i<(int)(sizeof(malformed)/sizeof(malformed[0])); i++) {
+		value=parse(malformed[i]);
+		check(!value || value->type!=JSON_TYPE_NUMERIC, "malformed", malformed[i]);
+		mixParse(malformed[i]);
+		jsonFree(value);
+	}
+
+	// up to 17 significant digits mostly, longer ones take the truncated path
+	for(n=0; n<200000; n++) {
+		p=input;
+		if(rnd()%2) *p++='-';
+		if(rnd()%4==0) *p++='0';
+		else {
+			digits=1+rnd()%(n%3 ? 17 : 30);
+			*p++='1'+rnd()%9;
+			for(i=1; i<digits; i++) *p++='0'+rnd()%10;
+		}
+		if(rnd()%3) {
+			*p++='.';
+			digits=1+rnd()%(n%3 ? 17 : 30);
+			for(i=0; i<digits; i++) *p++='0'+rnd()%10;
+		}
+		if(rnd()%2) p+=sprintf(p, "e%d", (int)(rnd()%660)-340);
+		*p='\0';
+		checkNumber(input);
+	}
+}
+
+/* significant digits of a number written by the library or printf() */
+static int significant(const char *str)
+{
+	int n = 0;
+
+	while(*str=='-' || *str=='0' || *str=='.') str++;
+	for(; *str && *str!='e' && *str!='E'; str++) {
+		if(*str>='0' && *str<='9') n++;
+	}
+	for(str--; n>1 && (*str=='0' || *str=='.'); str--) {
+		if(*str=='0') n--;
+	}
+
+	return n;
+}
+
+/* written doubles read back to the same bits and are no longer than the 
+ * shortest printf() form that does, integers match printf()
+ */
+static void checkDouble(double d)
+{
+	json_t node, *value;
+	char buf[64], shortest[64];
+	double back;
+	int p;
+
+	jsonSetNumeric(&node, d);
+	jsonWriteJson(&node, buf, sizeof(buf));
+	back=strtod(buf, NULL);
+	check(memcmp(&back, &d, sizeof(double))==0, "round trip", buf);
+
+	for(p=1; p<17; p++) {
+		snprintf(shortest, sizeof(shortest), "%.*g", p, d);
+		if(strtod(shortest, NULL)==d) break;
+	}
+	snprintf(shortest, sizeof(shortest), "%.*g", p, d);
+	check(significant(buf)<=significant(shortest), "shortest", buf);
+
+	value=parse(buf);
+	check(value && value->type==JSON_TYPE_NUMERIC && memcmp(&value->numeric, &d, sizeof(double))==0, "read back", buf);
+	jsonFree(value);
+}
+
+static void testFormat(void)
+{
+	static const double edge[]={
+		0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0/3, 2.0/3, 100.0, 1e21, 1e22, 1e23, 123456789012345680.0,
+		9007199254740992.0, 9007199254740994.0, 1.7976931348623157e308, 2.2250738585072014e-308,
+		2.2250738585072009e-308, 4.9406564584124654e-324, 1e-7, 1e-6, 1e-5, 0.001, 5e-324, 1e16, 1e15,
+	};
+	static const int64_t integer[]={ 0, 1, -1, 9, 10, 99, 100, INT32_MAX, INT32_MIN, INT64_MAX, INT64_MIN };
+	json_t node;
+	uint64_t bits;
+	int64_t n;
+	double d;
+	char buf[64], expect[64];
+	int i;
+
+	for(i=0; i<(int)(sizeof(edge)/sizeof(edge[0])); i++) checkDouble(edge[i]);
+
+	for(i=0; i<300000; i++) {
+		bits=rnd();
+		if((bits>>52&0x7ff)==0x7ff) continue;  // inf and nan are not JSON
+		memcpy(&d, &bits, sizeof(double));
+		checkDouble(d);
+
+		// short decimals, the common case
+		checkDouble(rndReal((int64_t)(rnd()%2000000)-1000000, 8)/1000);
+	}
+
+	// the smallest subnormals, then random ones and their normal neighbours
+	for(i=1; i<1000; i++) {
+		bits=i;
+		memcpy(&d, &bits, sizeof(double));
+		checkDouble(d);
+		bits=rnd()&((1ull<<53)-1);
+		memcpy(&d, &bits, sizeof(double));
+		checkDouble(d);
+	}
+
+	for(i=0; i<(int)(sizeof(integer)/sizeof(integer[0])) || i<100000; i++) {
+		if(i<(int)(sizeof(integer)/sizeof(integer[0]))) n=integer[i];
+		else n=rndInt();
+		jsonSetInteger(&node, n);
+		jsonWriteJson(&node, buf, sizeof(buf));
+		snprintf(expect, sizeof(expect), "%lld", (long long)n);
+		check(strcmp(buf, expect)==0, "integer text", buf);
+	}
+}
+
+/* random document text, alphanumeric unique labels so every value can be 
+ * reached by a query, whitespace everywhere the grammar allows it
+ */
+static char *gen(char *p, int depth)
+{
+	static const char *ws[]={ "", "", " ", "\n  ", "\t", " \r\n " };
+	static const char *piece[]={ "x", "long text ", "\\n", "\\\"", "\\\\", "\\t", "\\/", "\xc3\xa9", "0123456789abcdef" };
+	int i, n, kind;
+
+	p+=sprintf(p, "%s", ws[rnd()%6]);
+	kind=depth>5 ? rnd()%6 : rnd()%8;
+	switch(kind) {
+		case 0:
+			p+=sprintf(p, "%lld", (long long)rndInt());
+			break;
+		case 1:
+			n=1+rnd()%17;
+			n=sprintf(p, "%.*g", n, rndReal((int64_t)rnd(), 60));
+			if(!strpbrk(p, ".e")) n+=sprintf(p+n, ".5");
+			p+=n;
+			break;
+		case 2:
+			p+=sprintf(p, "%s", rnd()%2 ? "true" : "false");
+			break;
+		case 3:
+			p+=sprintf(p, "null");
+			break;
+		case 4:
+		case 5:
+			*p++='\"';
+			for(n=rnd()%8; n>0; n--) p+=sprintf(p, "%s", piece[rnd()%9]);
+			*p++='\"';
+			break;
+		case 6:
+			*p++='[';
+			n=rnd()%3 ? rnd()%5 : rnd()%(depth<2 ? 40 : 12);
+			for(i=0; i<n; i++) {
+				if(i) *p++=',';
+				p=gen(p, depth+1);
+			}
+			p+=sprintf(p, "%s]", ws[rnd()%6]);
+			break;
+		case 7:
+			*p++='{';
+			n=rnd()%3 ? rnd()%5 : rnd()%(depth<2 ? 40 : 12);
+			for(i=0; i<n; i++) {
+				if(i) *p++=',';
+				p+=sprintf(p, "%s\"k%d", ws[rnd()%6], i);
+				p+=sprintf(p, "%s\"", rnd()%2 ? "" : "long");
+				p+=sprintf(p, "%s:", ws[rnd()%6]);
+				p=gen(p, depth+1);
+			}
+			p+=sprintf(p, "%s}", ws[rnd()%6]);
+			break;
+	}
+	p+=sprintf(p, "%s", ws[rnd()%6]);
+	*p='\0';
+
+	return p;
+}
+
+/* SAX events back into a tree */
+typedef struct saxTree_t {
+	json_t *root;
+	json_t *stack[64];
+	int depth;
+	char *label;
+} saxTree_t;
+
+static bool saxAdd(saxTree_t *t, json_t *value)
+{
+	if(t->label) {
+		jsonLabelName(value, t->label);
+		free(t->label);
+		t->label=NULL;
+	}
+	if(t->depth) jsonInsertList(t->stack[t->depth-1], value);
+	else t->root=value;
+
+	return true;
+}
+
+static json_t *saxNode(void)
+{
+	return calloc(1, sizeof(json_t));
+}
+
+static bool saxOpen(saxTree_t *t, bool object)
+{
+	json_t *value = saxNode();
+
+	if(object) jsonSetObject(value, NULL);
+	else jsonSetArray(value, NULL);
+	saxAdd(t, value);
+	t->stack[t->depth++]=value;
+
+	return true;
+}
+
+static bool saxStartObject(void *ctx) { return saxOpen(ctx, true); }
+static bool saxStartArray(void *ctx) { return saxOpen(ctx, false); }
+
+static bool saxClose(void *ctx)
+{
+	((saxTree_t *)ctx)->depth--;
+
+	return true;
+}
+
+static bool saxKey(void *ctx, const char *str, size_t len)
+{
+	((saxTree_t *)ctx)->label=strndup(str, len);
+
+	return true;
+}
+
+static bool saxString(void *ctx, const char *str, size_t len)
+{
+	json_t *value = saxNode();
+	char *copy = strndup(str, len);
+
+	jsonSetString(value, copy);
+	free(copy);
+
+	return saxAdd(ctx, value);
+}
+
+static bool saxInteger(void *ctx, int64_t n)
+{
+	json_t *value = saxNode();
+
+	jsonSetInteger(value, n);
+
+	return saxAdd(ctx, value);
+}
+
+static bool saxNumeric(void *ctx, double d)
+{
+	json_t *value = saxNode();
+
+	jsonSetNumeric(value, d);
+
+	return saxAdd(ctx, value);
+}
+
+static bool saxBoolean(void *ctx, bool b)
+{
+	json_t *value = saxNode();
+
+	jsonSetBoolean(value, b);
+
+	return saxAdd(ctx, value);
+}
+
+static bool saxNull(void *ctx)
+{
+	return saxAdd(ctx, saxNode());
+}
+
+static const jsonSax_t saxTree={
+	saxStartObject, saxClose, saxStartArray, saxClose, saxKey,
+	saxString, saxInteger, saxNumeric, saxBoolean, saxNull
+};
+
+static void checkText(json_t *value, const char *expect, const char *what, const char *input)
+{
+	char *out;
+
+	out=text(value);
+	check(same(out, expect), what, input);
+	free(out);
+}
+
+/* the queries of the values in 'value', into 'path' from 'len' on, as 
+ * many as 'budget' allows
+ */
+static void checkPaths(json_t *value, char *path, size_t len, jsonDoc_t *doc, jsonTape_t *tape, const char *input, int *budget)
+{
+	char *expect;
+	json_t *ptr;
+	int i;
+
+	if(--*budget<0) return;
+
+	expect=text(value);
+	checkText(jsonQuery(jsonDocQuery(doc, ""), path), expect, "doc root query", input);
+	checkText(jsonDocQuery(doc, path), expect, "doc query", input);
+	checkText(jsonTapeQuery(tape, path), expect, "tape query", input);
+	free(expect);
+
+	if(len>200 || (value->type!=JSON_TYPE_ARRAY && value->type!=JSON_TYPE_OBJECT)) return;
+
+	for(ptr=value->list, i=0; ptr!=NULL; ptr=ptr->next, i++) {
+		if(value->type==JSON_TYPE_ARRAY) sprintf(path+len, "[%d]", i);
+		else sprintf(path+len, "%s%s", len ? "." : "", ptr->label);
+		checkPaths(ptr, path, strlen(path), doc, tape, input, budget);
+	}
+	path[len]='\0';
+}
+
+/* every way in builds the tree jsonParse() does */
+static void checkSame(const char *input)
+{
+	static const size_t step[]={ 1, 7, 64, 4096 };
+	jsonArena_t *arena;
+	jsonParser_t *parser;
+	jsonKeys_t *keys;
+	jsonDoc_t *doc;
+	jsonTape_t *tape;
+	saxTree_t tree;
+	json_t *ref, *value, *got;
+	char *expect, *copy, path[256];
+	size_t len, at, n;
+	void *pack;
+	int i, budget;
+
+	ref=parse(input);
+	expect=text(ref);
+	mix(expect ? expect : "-", expect ? strlen(expect) : 1);
+	len=strlen(input);
+	arena=jsonArenaNew(0);
+
+	value=jsonParseN(input, len);
+	checkText(value, expect, "jsonParseN", input);
+	jsonFree(value);
+
+	copy=strdup(input);
+	checkText(jsonParseInArena(arena, copy), expect, "jsonParseInArena", input);
+	strcpy(copy, input);
+	checkText(jsonParseInSitu(copy, arena), expect, "jsonParseInSitu", input);
+	keys=jsonKeysNew(false);
+	strcpy(copy, input);
+	checkText(jsonParseWithKeys(copy, arena, keys), expect, "jsonParseWithKeys", input);
+	jsonKeysFree(keys);
+	free(copy);
+	jsonArenaReset(arena);
+
+	parser=jsonParserNew();
+	value=jsonParserParse(parser, input, len);
+	checkText(value, expect, "jsonParserParse", input);
+	jsonParserRelease(parser, value);
+
+	for(i=0; i<(int)(sizeof(step)/sizeof(step[0])); i++) {
+		jsonParserReset(parser);
+		got=NULL;
+		for(at=0; at<len; at+=n) {
+			n=(len-at<step[i]) ? len-at : step[i];
+			value=jsonParserFeed(parser, input+at, n);
+			if(value && !got) got=value;
+			else jsonFree(value);
+		}
+		value=jsonParserFeed(parser, NULL, 0);
+		if(value && !got) got=value;
+		else jsonFree(value);
+		checkText(ref ? got : NULL, expect, "jsonParserFeed", input);
+		jsonFree(got);
+	}
+	jsonParserFree(parser);
+
+	if(!ref) {
+		jsonArenaFree(arena);
+		return;
+	}
+
+	memset(&tree, 0, sizeof(tree));
+	check(jsonSaxParse(input, &saxTree, &tree), "jsonSaxParse", input);
+	checkText(tree.root, expect, "jsonSaxParse", input);
+	jsonFree(tree.root);
+
+	value=jsonCopy(ref);
+	checkText(value, expect, "jsonCopy", input);
+	jsonFree(value);
+
+	pack=jsonPack(ref, &n);
+	value=jsonUnpack(pack, n);
+	checkText(value, expect, "jsonUnpack", input);
+	jsonFree(value);
+	checkText(jsonUnpackInArena(arena, pack, n), expect, "jsonUnpackInArena", input);
+	memset(&tree, 0, sizeof(tree));
+	check(jsonSaxUnpack(pack, n, &saxTree, &tree), "jsonSaxUnpack", input);
+	checkText(tree.root, expect, "jsonSaxUnpack", input);
+	jsonFree(tree.root);
+	free(pack);
+
+	doc=jsonDocNew(input);
+	check(jsonTapeSave(ref, "json_test.tape"), "jsonTapeSave", input);
+	tape=jsonTapeOpen("json_test.tape");
+	path[0]='\0';
+	budget=100;
+	if(doc && tape) checkPaths(ref, path, 0, doc, tape, input, &budget);
+	else check(false, "doc/tape open", input);
+	jsonDocFree(doc);
+	jsonTapeClose(tape);
+	unlink("json_test.tape");
+
+	jsonArenaFree(arena);
+	jsonFree(ref);
+	free(expect);
+}
+
+static void testSame(void)
+{
+	static const char *fixed[]={
+		"{}", "[]", "0", "-1.5", "\"\"", "true", "null", "[[[[]]]]", "{\"a\":{\"b\":{\"c\":[1,{\"d\":null}]}}}",
+		"  {\"name\" : \"record 1\" , \"tags\" : [ \"a\" , \"b\" ] }  ",
+		"[1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20]",
+		"{\"k0\":0,\"k1\":1,\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,\"k9\":9,\"k10\":10}",
+		"[1,]", "{\"a\"}", "[\"open", "{\"a\":1,,}", "tru", "[1 2]",
+	};
+	char *buf;
+	int i;
+
+	for(i=0; i<(int)(sizeof(fixed)/sizeof(fixed[0])); i++) checkSame(fixed[i]);
+
+	buf=malloc(1<<22);
+	for(i=0; i<3000; i++) {
+		gen(buf, 0);
+		checkSame(buf);
+	}
+	free(buf);
+}
+
+/* values of a JSON Lines run, checked against jsonParseN() line by line */
+typedef struct linesRun_t {
+	const char *buf;
+	size_t *offset;  // of the first non-blank byte of each line
+	char **expect;   // text of its value, NULL if malformed
+	int count;
+	int next;        // ordered runs: the line due
+	int *seen;       // unordered runs: calls per line
+	bool ordered;
+} linesRun_t;
+
+static bool onLine(void *ctx, json_t *value, size_t offset)
+{
+	linesRun_t *run = ctx;
+	int lo = 0, hi = run->count-1, mid;
+
+	while(lo<hi) {
+		mid=(lo+hi)/2;
+		if(run->offset[mid]<offset) lo=mid+1;
+		else hi=mid;
+	}
+	check(run->offset[lo]==offset, "line offset", run->buf+offset);
+	checkText(value, run->expect[lo], "line value", run->buf+offset);
+
+	if(run->ordered) check(lo==run->next++, "line order", run->buf+offset);
+	else __atomic_add_fetch(&run->seen[lo], 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+static void testLines(void)
+{
+	static const char *odd[]={ "", "   ", "\t", "[1,]", "{\"a\":", "\"open", "nul" };
+	linesRun_t run;
+	json_t *value;
+	char *buf, *p, *line;
+	size_t size = 6<<20, len;
+	int64_t n;
+	int i, threads, fd;
+	FILE *fp;
+
+	buf=malloc(size+(1<<20));
+	run.buf=buf;
+	run.count=0;
+
+	// several chunks of lines, some blank, some malformed
+	for(p=buf; p<buf+size; ) {
+		line=p;
+		if(rnd()%10==0) p+=sprintf(p, "%s", odd[rnd()%7]);
+		else p=gen(p, 2);
+		for(; line<p; line++) if(*line=='\n' || *line=='\r') *line=' ';
+		*p++='\n';
+	}
+	*p='\0';
+	len=p-buf;
+
+	for(n=0, p=buf; (p=strchr(p, '\n')); p++) n++;
+	run.offset=malloc(sizeof(size_t)*n);
+	run.expect=malloc(sizeof(char *)*n);
+	for(line=buf; line<buf+len; line=p+1) {
+		p=strchr(line, '\n');
+		while(line<p && (*line==' ' || *line=='\t')) line++;
+		if(line==p) continue;
+		value=jsonParseN(line, p-line);
+		run.offset[run.count]=line-buf;
+		run.expect[run.count]=text(value);
+		run.count++;
+		jsonFree(value);
+	}
+
+	for(threads=1; threads<=4; threads*=4) {
+		run.ordered=true;
+		run.next=0;
+		n=jsonLinesParse(buf, len, threads, true, onLine, &run);
+		check(n==run.count && run.next==run.count, "ordered lines", "");
+
+		run.ordered=false;
+		run.seen=calloc(run.count, sizeof(int));
+		n=jsonLinesParse(buf, len, threads, false, onLine, &run);
+		check(n==run.count, "unordered lines", "");
+		for(i=0; i<run.count; i++) check(run.seen[i]==1, "unordered line seen once", buf+run.offset[i]);
+		free(run.seen);
+	}
+
+	fp=fopen("json_test.jsonl", "w");
+	fwrite(buf, 1, len, fp);
+	fclose(fp);
+	run.ordered=true;
+	run.next=0;
+	n=jsonLinesFile("json_test.jsonl", 3, true, onLine, &run);
+	check(n==run.count && run.next==run.count, "lines file", "");
+
+	fd=open("json_test.jsonl", O_RDONLY);
+	run.next=0;
+	n=jsonLinesRead(fd, 2, true, onLine, &run);
+	check(n==run.count && run.next==run.count, "lines read", "");
+	close(fd);
+	unlink("json_test.jsonl");
+
+	// a descriptor that can not be read
+	fd=open(".", O_RDONLY);
+	json_error=JSON_ERROR_NONE;
+	n=jsonLinesRead(fd, 2, true, onLine, &run);
+	check(n==-1 && json_error==JSON_ERROR_IO, "lines read error", "");
+	close(fd);
+
+	for(i=0; i<run.count; i++) free(run.expect[i]);
+	free(run.expect);
+	free(run.offset);
+	free(buf);
+}
+
+/* members of indexed objects renamed both ways, lookups agree with a walk */
+static void testRename(void)
+{
+	char input[]="{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9}";
+	json_t *root, *other, *member;
+
+	root=parse(input);
+	other=parse(input);
+
+	member=jsonQuery(root, "c");
+	check(jsonLabelName(member, "x"), "jsonLabelName", "c");
+	check(jsonQuery(root, "x")==member && !jsonQuery(root, "c"), "renamed lookup", "x");
+	check(jsonQuery(other, "c") && jsonQuery(other, "c")->integer==2, "other index", "c");
+
+	check(jsonLabelName(jsonQuery(root, "j"), "a"), "jsonLabelName", "j");
+	check(jsonQuery(root, "a")->integer==0, "first of two labels", "a");
+	check(jsonLabelMember(root, jsonQuery(root, "a"), "y"), "jsonLabelMember", "a");
+	check(jsonQuery(root, "a")->integer==9 && jsonQuery(root, "y")->integer==0, "renamed member", "y");
+
+	jsonFree(root);
+	jsonFree(other);
+}
+
+/* a tape whose object has every hash slot taken still answers queries */
+static void testTape(void)
+{
+	char input[]="{\"a\":0,\"b\":1,\"c\":2,\"d\":3,\"e\":4,\"f\":5,\"g\":6,\"h\":7,\"i\":8,\"j\":9}";
+	uint64_t table;
+	uint32_t count, slot[2];
+	jsonTape_t *tape;
+	json_t *root;
+	FILE *fp;
+	int i;
+
+	root=parse(input);
+	check(jsonTapeSave(root, "json_test.tape"), "tape save", input);
+	jsonFree(root);
+
+	// the root record follows the 24-byte header, its member table and the
+	// 32 slots behind it are at an offset from the file start
+	fp=fopen("json_test.tape", "r+b");
+	fseek(fp, 24, SEEK_SET);
+	check(fread(&table, 8, 1, fp)==1, "tape root", "");
+	fseek(fp, 40, SEEK_SET);
+	check(fread(&count, 4, 1, fp)==1 && count==10, "tape root", "");
+	slot[0]=0;
+	slot[1]=1;
+	fseek(fp, table+count*24, SEEK_SET);
+	for(i=0; i<32; i++) fwrite(slot, 4, 2, fp);
+	fclose(fp);
+
+	tape=jsonTapeOpen("json_test.tape");
+	check(tape!=NULL, "tape open", "");
+	if(tape) {
+		check(!jsonTapeQuery(tape, "z"), "full slots", "z");
+		jsonTapeClose(tape);
+	}
+	unlink("json_test.tape");
+}
+
+/* an allocator that can be told to refuse */
+static bool refuse;
+
+static void *refuseMalloc(void *ctx, size_t size)
+{
+	(void)ctx;
+	return refuse ? NULL : malloc(size);
+}
+
+static void *refuseRealloc(void *ctx, void *ptr, size_t size)
+{
+	(void)ctx;
+	return refuse ? NULL : realloc(ptr, size);
+}
+
+static void refuseFree(void *ctx, void *ptr)
+{
+	(void)ctx;
+	free(ptr);
+}
+
+/* with no memory left for their stacks, the writers fail rather than
+ * recurse, shallow trees are still written and every tree is freed
+ */
+static void testDeep(void)
+{
+	static const jsonAllocator_t alloc = { refuseMalloc, refuseRealloc, refuseFree, NULL, NULL };
+	jsonAllocStats_t stats = { 0, 0, 0, 1 };
+	const jsonAllocator_t *prev;
+	char input[256], text2[2048];
+	json_t *deep, *flat, *wide;
+	char *p;
+	int i;
+
+	for(i=0; i<100; i++) input[i]='[';
+	for(; i<200; i++) input[i]=']';
+	input[i]='\0';
+	deep=parse(input);
+	flat=parse("[1,{\"a\":[2,{}]}]");
+
+	// siblings behind every level
+	for(p=text2, i=0; i<100; i++) *p++='[';
+	for(*p++='0', i=0; i<100; i++) p+=sprintf(p, ",{\"a\":%d}]", i);
+	prev=jsonSetThreadAllocator(&alloc);
+	wide=parse(text2);
+	check(wide, "wide parse", text2);
+	refuse=true;
+	jsonFree(wide);
+	refuse=false;
+	jsonSetThreadAllocator(prev);
+
+	jsonSetAllocStats(&stats);
+	json_error=JSON_ERROR_NONE;
+	check(jsonWriteJson(deep, NULL, 0)==0 && json_error==JSON_ERROR_MEMORY, "deep write", input);
+	check(!jsonGetString(deep), "deep string", input);
+	check(jsonPackWrite(deep, NULL, 0)==0 && !jsonPack(deep, NULL), "deep pack", input);
+	check(jsonWriteJson(flat, NULL, 0)>0 && jsonPackWrite(flat, NULL, 0)>0, "flat write", "");
+	jsonSetAllocStats(NULL);
+
+	check(jsonWriteJson(deep, NULL, 0)>0 && jsonPackWrite(deep, NULL, 0)>0, "deep write", input);
+
+	jsonFree(deep);
+	jsonFree(flat);
+}
+
+int main(void)
+{
+	testScan();
+	testMangle();
+	testNumbers();
+	testFormat();
+	testSame();
+	testLines();
+	testRename();
+	testTape();
+	testDeep();
+
+	printf("%d checks, %d failed\n", checks, failures);
+	printf("digest %016llx\n", (unsigned long long)digest);
+
+	return failures ? 1 : 0;
+}
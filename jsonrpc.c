@@ -50,11 +50,11 @@ jsonrpc_t *jsonrpcNew(const char *m, int type)
 {
     jsonrpc_t *rpc;
 
-    rpc=malloc(sizeof(jsonrpc_t));
+    rpc=jsonPoolAlloc(sizeof(jsonrpc_t));
     memset(rpc, 0, sizeof(jsonrpc_t));
     rpc->type=type;
 
-    rpc->method=malloc(strlen(m)+1);
+    rpc->method=jsonMemAlloc(strlen(m)+1);
     strcpy(rpc->method, m);
 
     return rpc;
@@ -74,7 +74,7 @@ jsonrpc_t *jsonrpcResult(json_t *result)
 {
     jsonrpc_t *rpc;
 
-    rpc=malloc(sizeof(jsonrpc_t));
+    rpc=jsonPoolAlloc(sizeof(jsonrpc_t));
     memset(rpc, 0, sizeof(jsonrpc_t));
     rpc->type=JSONRPC_RESPONSE;
 
@@ -105,7 +105,7 @@ json_t *jsonrpcSetIdNull(jsonrpc_t *rpc)
 {
     if(!rpc) return NULL;
 
-    rpc->id=malloc(sizeof(json_t));
+    rpc->id=jsonPoolAlloc(sizeof(json_t));
     jsonSetNull(rpc->id);
     return rpc->id;
 }
@@ -114,7 +114,7 @@ json_t *jsonrpcSetIdInteger(jsonrpc_t *rpc, int64_t id)
 {
     if(!rpc) return NULL;
 
-    rpc->id=malloc(sizeof(json_t));
+    rpc->id=jsonPoolAlloc(sizeof(json_t));
     jsonSetInteger(rpc->id, id);
     return rpc->id;
 }
@@ -123,7 +123,7 @@ json_t *jsonrpcSetIdString(jsonrpc_t *rpc, char *id)
 {
     if(!rpc) return NULL;
 
-    rpc->id=malloc(sizeof(json_t));
+    rpc->id=jsonPoolAlloc(sizeof(json_t));
     jsonSetString(rpc->id, id);
     return rpc->id;
 }
@@ -142,81 +142,129 @@ int jsonrpcNumParams(jsonrpc_t *rpc)
 }
 
 /* RPC Export */
-int _jsonrpcExportObject(jsonrpc_t *rpc, char *buf)
+/* the writers below follow jsonWriteJson(): output is bounded by 'size' 
+ * (including the NUL), the returned length is always the full one
+ */
+size_t _jsonrpcPut(char *buf, size_t size, size_t len, const char *str)
 {
-    char *str;
-    int len;
+    size_t n;
+
+    n=strlen(str);
+    if(len<size) {
+        if(len+n<size) memcpy(&buf[len], str, n+1);
+        else {
+            memcpy(&buf[len], str, size-len-1);
+            buf[size-1]='\0';
+        }
+    }
 
-    len=sprintf(buf, "{\"jsonrpc\": \"2.0\"");
+    return len+n;
+}
+
+size_t _jsonrpcPutJson(char *buf, size_t size, size_t len, json_t *value)
+{
+    json_t null;
+
+    if(!value) {
+        jsonSetNull(&null);
+        value=&null;
+    }
+
+    if(len<size) return len+jsonWriteJson(value, &buf[len], size-len);
+    else return len+jsonWriteJson(value, NULL, 0);
+}
+
+size_t _jsonrpcExportObject(jsonrpc_t *rpc, char *buf, size_t size)
+{
+    json_t str, code;
+    size_t len;
+
+    len=_jsonrpcPut(buf, size, 0, "{\"jsonrpc\": \"2.0\"");
 
     switch(rpc->type) {
         case JSONRPC_REQUEST:
         case JSONRPC_NOTIFICATION:
-            len+=sprintf(&buf[len], ", \"method\": \"%s\"", rpc->method);
+            jsonRefString(&str, rpc->method ? rpc->method : "");
+            len=_jsonrpcPut(buf, size, len, ", \"method\": ");
+            len=_jsonrpcPutJson(buf, size, len, &str);
             if(rpc->params) {
-                str=jsonGetString(rpc->params);
-                len+=sprintf(&buf[len], ", \"params\": %s", str);
-                free(str);
+                len=_jsonrpcPut(buf, size, len, ", \"params\": ");
+                len=_jsonrpcPutJson(buf, size, len, rpc->params);
             }
             break;
         case JSONRPC_RESPONSE:
-            str=jsonGetString(rpc->result);
-
-            if(rpc->result->type==JSON_TYPE_STRING) len+=sprintf(&buf[len], ", \"result\": \"%s\"", str);
-            else len+=sprintf(&buf[len], ", \"result\": %s", str);
-
-            free(str);
+            len=_jsonrpcPut(buf, size, len, ", \"result\": ");
+            len=_jsonrpcPutJson(buf, size, len, rpc->result);
             break;
         case JSONRPC_ERROR:
-            len+=sprintf(&buf[len], ", \"error\": {\"code\": %d, \"message\": %s", rpc->errorCode, rpc->errorMessage);
+            jsonSetInteger(&code, rpc->errorCode);
+            jsonRefString(&str, rpc->errorMessage ? rpc->errorMessage : "");
+            len=_jsonrpcPut(buf, size, len, ", \"error\": {\"code\": ");
+            len=_jsonrpcPutJson(buf, size, len, &code);
+            len=_jsonrpcPut(buf, size, len, ", \"message\": ");
+            len=_jsonrpcPutJson(buf, size, len, &str);
             if(rpc->errorData) {
-                str=jsonGetString(rpc->errorData);
-                len+=sprintf(&buf[len], ", \"data\": %s", str);
-                free(str);
+                len=_jsonrpcPut(buf, size, len, ", \"data\": ");
+                len=_jsonrpcPutJson(buf, size, len, rpc->errorData);
             }
-            buf[len++]='}';
+            len=_jsonrpcPut(buf, size, len, "}");
             break;
     }
 
     if(rpc->type!=JSONRPC_NOTIFICATION && rpc->id) {
-        str=jsonGetString(rpc->id);
-        len+=sprintf(&buf[len], ", \"id\": %s", str);
-        free(str);
+        len=_jsonrpcPut(buf, size, len, ", \"id\": ");
+        len=_jsonrpcPutJson(buf, size, len, rpc->id);
     }
 
-    buf[len++]='}';
-    
-    return len;
+    return _jsonrpcPut(buf, size, len, "}");
 }
 
-char *jsonrpcExport(jsonrpc_t *rpc)
+/* writes the export into buf (at most size bytes, always NUL-terminated), 
+ * returns the full length without the NUL, 0 if there is nothing to export 
+ * or a value could not be written (JSON_ERROR_MEMORY)
+ */
+size_t jsonrpcWrite(jsonrpc_t *rpc, char *buf, size_t size)
 {
-    char buf[4096];
-    char *str;
-    int len;
+    size_t len;
 
-    if(!rpc || rpc->type==JSONRPC_UNDEFINED) return NULL;
+    if(!rpc || rpc->type==JSONRPC_UNDEFINED) return 0;
+    if(!buf) size=0;
+    json_error=JSON_ERROR_NONE;
 
-    if(rpc->next) {
-        len=0;
-        buf[len++]='[';
+    if(rpc->next) { // batch
+        len=_jsonrpcPut(buf, size, 0, "[");
         while(rpc) {
-            len+=_jsonrpcExportObject(rpc, &buf[len]);
-            buf[len++]=',';
-            buf[len++]=' ';
+            if(len<size) len+=_jsonrpcExportObject(rpc, &buf[len], size-len);
+            else len+=_jsonrpcExportObject(rpc, NULL, 0);
+
+            if(rpc->next) len=_jsonrpcPut(buf, size, len, ", ");
             rpc=rpc->next;
         }
-        len-=2;
-        buf[len++]=']';
-    }
-    else {
-        len=_jsonrpcExportObject(rpc, buf);
+        len=_jsonrpcPut(buf, size, len, "]");
     }
+    else len=_jsonrpcExportObject(rpc, buf, size);
+
+    if(json_error==JSON_ERROR_MEMORY) return 0;
+
+    return len;
+}
 
-    buf[len++]='\0';
+char *jsonrpcExport(jsonrpc_t *rpc)
+{
+    char *str;
+    size_t len;
 
-    str=malloc(len);
-    strcpy(str, buf);
+    if(!rpc || rpc->type==JSONRPC_UNDEFINED) return NULL;
+
+    len=jsonrpcWrite(rpc, NULL, 0);
+    if(!len) return NULL;
+    str=jsonMemAlloc(len+1);
+    if(!str) return NULL;
+
+    if(jsonrpcWrite(rpc, str, len+1)!=len) {
+        jsonMemFree(str);
+        return NULL;
+    }
 
     return str;
 }
@@ -241,7 +289,7 @@ jsonrpc_t *_jsonrpcReqFromObject(json_t *object)
     if(!attr || attr->type!=JSON_TYPE_STRING) {
         return jsonrpcError(-32600, "Invalid request");
     }
-    rpc=malloc(sizeof(jsonrpc_t));
+    rpc=jsonPoolAlloc(sizeof(jsonrpc_t));
     memset(rpc, 0, sizeof(jsonrpc_t));
     rpc->method=jsonGetString(attr);
 
@@ -326,7 +374,7 @@ jsonrpc_t *_jsonrpcResFromObject(json_t *object)
     }
     ///TODO: check version
 
-    rpc=malloc(sizeof(jsonrpc_t));
+    rpc=jsonPoolAlloc(sizeof(jsonrpc_t));
     memset(rpc, 0, sizeof(jsonrpc_t));
 
     ///TODO: result and error are mutual exclusive
@@ -388,13 +436,251 @@ jsonrpc_t *jsonrpcParseResponse(char *str)
     return rpc;
 }
 
+/* requests of a parsed tree (NULL for a parse error), batches chained */
+jsonrpc_t *_jsonrpcReqFromTree(json_t *root)
+{
+    jsonrpc_t *rpc, *rpct=NULL, *nrpc;
+    json_t *data;
+
+    if(!root) return jsonrpcError(-32700, "Parse error");
+
+    if(root->type==JSON_TYPE_OBJECT) data=root;
+    else if(root->type==JSON_TYPE_ARRAY && root->list) data=root->list;
+    else return jsonrpcError(-32600, "Invalid request");
+
+    rpc=NULL;
+    for(; data; data=(root->type==JSON_TYPE_ARRAY)?data->next:NULL) {
+        nrpc=_jsonrpcReqFromObject(data);
+        if(!nrpc) continue;
+
+        if(!rpc) rpc=nrpc;
+        else rpct->next=nrpc;
+        rpct=nrpc;
+    }
+
+    return rpc;
+}
+
+/* RPC MessagePack, the same members as the JSON text */
+void _jsonrpcMember(json_t *dst, const char *label, json_t *value, json_t *next)
+{
+    if(value) *dst=*value;  // shallow view, the tree is only read
+    else jsonSetNull(dst);
+
+    dst->label=(char *)label;
+    dst->refLabel=true;
+    dst->interned=false;
+    dst->next=next;
+}
+
+size_t _jsonrpcPackObject(jsonrpc_t *rpc, void *buf, size_t size)
+{
+    json_t object, member[5], error[3], code, message;
+    int n;
+
+    n=0;
+    jsonRefString(&member[n], "2.0");
+    _jsonrpcMember(&member[n], "jsonrpc", &member[n], NULL);
+    n++;
+
+    switch(rpc->type) {
+        case JSONRPC_REQUEST:
+        case JSONRPC_NOTIFICATION:
+            jsonRefString(&member[n], rpc->method ? rpc->method : "");
+            _jsonrpcMember(&member[n], "method", &member[n], NULL);
+            n++;
+            if(rpc->params) {
+                _jsonrpcMember(&member[n], "params", rpc->params, NULL);
+                n++;
+            }
+            break;
+        case JSONRPC_RESPONSE:
+            _jsonrpcMember(&member[n], "result", rpc->result, NULL);
+            n++;
+            break;
+        case JSONRPC_ERROR:
+            jsonSetInteger(&code, rpc->errorCode);
+            jsonRefString(&message, rpc->errorMessage ? rpc->errorMessage : "");
+            _jsonrpcMember(&error[2], "data", rpc->errorData, NULL);
+            _jsonrpcMember(&error[1], "message", &message, rpc->errorData ? &error[2] : NULL);
+            _jsonrpcMember(&error[0], "code", &code, &error[1]);
+            jsonSetNull(&member[n]);
+            member[n].type=JSON_TYPE_OBJECT;
+            member[n].list=&error[0];
+            _jsonrpcMember(&member[n], "error", &member[n], NULL);
+            n++;
+            break;
+    }
+
+    if(rpc->type!=JSONRPC_NOTIFICATION && rpc->id) {
+        _jsonrpcMember(&member[n], "id", rpc->id, NULL);
+        n++;
+    }
+
+    while(--n>0) member[n-1].next=&member[n];
+
+    jsonSetNull(&object);
+    object.type=JSON_TYPE_OBJECT;
+    object.list=&member[0];
+
+    return jsonPackWrite(&object, buf, size);
+}
+
+/* the MessagePack counterpart of jsonrpcWrite(), output is bounded by 
+ * 'size' and the full length returned (0 if out of memory)
+ */
+size_t jsonrpcPackWrite(jsonrpc_t *rpc, void *buf, size_t size)
+{
+    uint8_t head[5], *out = buf;
+    jsonrpc_t *ptr;
+    size_t len, n, i, count;
+
+    if(!rpc || rpc->type==JSONRPC_UNDEFINED) return 0;
+    if(!buf) size=0;
+
+    if(!rpc->next) return _jsonrpcPackObject(rpc, buf, size);
+    json_error=JSON_ERROR_NONE;
+
+    // batch, as an array header and the objects
+    count=0;
+    for(ptr=rpc; ptr; ptr=ptr->next) count++;
+
+    if(count<=15) {
+        head[0]=0x90|count;
+        n=1;
+    }
+    else if(count<=0xffff) {
+        head[0]=0xdc;
+        n=3;
+    }
+    else {
+        head[0]=0xdd;
+        n=5;
+    }
+    for(i=n-1; i>0; i--, count>>=8) head[i]=(uint8_t)count;
+
+    for(i=0; i<n && i<size; i++) out[i]=head[i];
+    len=n;
+
+    for(ptr=rpc; ptr; ptr=ptr->next) {
+        if(len<size) len+=_jsonrpcPackObject(ptr, &out[len], size-len);
+        else len+=_jsonrpcPackObject(ptr, NULL, 0);
+    }
+
+    if(json_error==JSON_ERROR_MEMORY) return 0;
+
+    return len;
+}
+
+void *jsonrpcPack(jsonrpc_t *rpc, size_t *len)
+{
+    void *rval;
+    size_t n;
+
+    if(!rpc || rpc->type==JSONRPC_UNDEFINED) return NULL;
+
+    n=jsonrpcPackWrite(rpc, NULL, 0);
+    if(!n) return NULL;
+    rval=jsonMemAlloc(n);
+    if(!rval) return NULL;
+
+    if(jsonrpcPackWrite(rpc, rval, n)!=n) {
+        jsonMemFree(rval);
+        return NULL;
+    }
+    if(len) *len=n;
+
+    return rval;
+}
+
+jsonrpc_t *jsonrpcUnpackRequest(const void *buf, size_t len)
+{
+    jsonrpc_t *rpc;
+    json_t *root;
+
+    root=jsonUnpack(buf, len);
+    rpc=_jsonrpcReqFromTree(root);
+    jsonFree(root);
+
+    return rpc;
+}
+
+jsonrpc_t *jsonrpcUnpackResponse(const void *buf, size_t len)
+{
+    jsonrpc_t *rpc, *rpct=NULL, *nrpc;
+    json_t *root, *data;
+
+    root=jsonUnpack(buf, len);
+
+    if(!root) return NULL;
+    else if(root->type==JSON_TYPE_OBJECT) data=root;
+    else if(root->type==JSON_TYPE_ARRAY) data=root->list;
+    else data=NULL;
+
+    rpc=NULL;
+    for(; data; data=(root->type==JSON_TYPE_ARRAY)?data->next:NULL) {
+        nrpc=_jsonrpcResFromObject(data);
+
+        if(!rpc) rpc=nrpc;
+        else rpct->next=nrpc;
+        rpct=nrpc;
+    }
+
+    jsonFree(root);
+    return rpc;
+}
+
+/* RPC Lines, requests converted by the JSON Lines workers */
+typedef struct jsonrpcLines_t {
+    jsonrpcLineFn_t fn;
+    void *ctx;
+} jsonrpcLines_t;
+
+bool _jsonrpcLine(void *ctx, json_t *value, size_t offset)
+{
+    jsonrpcLines_t *lines=ctx;
+    jsonrpc_t *rpc;
+
+    rpc=_jsonrpcReqFromTree(value);
+    if(!rpc) return true;
+
+    return lines->fn(lines->ctx, rpc, offset);
+}
+
+/* parses newline delimited requests (a batch per line allowed) as 
+ * jsonLinesParse() does, 'fn' takes over each rpc and jsonrpcFree()s it
+ */
+int64_t jsonrpcLinesParse(const char *buf, size_t len, int threads, bool ordered, jsonrpcLineFn_t fn, void *ctx)
+{
+    jsonrpcLines_t lines;
+
+    if(!fn) return -1;
+
+    lines.fn=fn;
+    lines.ctx=ctx;
+
+    return jsonLinesParse(buf, len, threads, ordered, _jsonrpcLine, &lines);
+}
+
+int64_t jsonrpcLinesFile(const char *path, int threads, bool ordered, jsonrpcLineFn_t fn, void *ctx)
+{
+    jsonrpcLines_t lines;
+
+    if(!fn) return -1;
+
+    lines.fn=fn;
+    lines.ctx=ctx;
+
+    return jsonLinesFile(path, threads, ordered, _jsonrpcLine, &lines);
+}
+
 /* clean up */
 void jsonrpcFree(jsonrpc_t *rpc)
 {
-    if(rpc->method) free(rpc->method);
+    if(rpc->method) jsonMemFree(rpc->method);
     if(rpc->params) jsonFree(rpc->params);
     if(rpc->id) jsonFree(rpc->id);
     if(rpc->next) jsonrpcFree(rpc->next);
 
-    free(rpc);
+    jsonPoolFree(rpc, sizeof(jsonrpc_t));
 }
@@ -77,6 +77,9 @@ typedef struct jsonrpc_t {
     struct jsonrpc_t *next;
 } jsonrpc_t;
 
+/* consumer of jsonrpcLinesParse(), returning false stops the run */
+typedef bool (*jsonrpcLineFn_t)(void *ctx, jsonrpc_t *rpc, size_t offset);
+
 jsonrpc_t *jsonrpcNew(const char *m, int type);
 jsonrpc_t *jsonrpcRequest(const char *m);
 jsonrpc_t *jsonrpcNotification(const char *m);
@@ -90,10 +93,19 @@ json_t *jsonrpcSetIdString(jsonrpc_t *rpc, char *id);
 int jsonrpcNumParams(jsonrpc_t *rpc);
 
 char *jsonrpcExport(jsonrpc_t *rpc);
+size_t jsonrpcWrite(jsonrpc_t *rpc, char *buf, size_t size);
 
 jsonrpc_t *jsonrpcParseRequest(char *str);
 jsonrpc_t *jsonrpcParseResponse(char *str);
 
+size_t jsonrpcPackWrite(jsonrpc_t *rpc, void *buf, size_t size);
+void *jsonrpcPack(jsonrpc_t *rpc, size_t *len);
+jsonrpc_t *jsonrpcUnpackRequest(const void *buf, size_t len);
+jsonrpc_t *jsonrpcUnpackResponse(const void *buf, size_t len);
+
+int64_t jsonrpcLinesParse(const char *buf, size_t len, int threads, bool ordered, jsonrpcLineFn_t fn, void *ctx);
+int64_t jsonrpcLinesFile(const char *path, int threads, bool ordered, jsonrpcLineFn_t fn, void *ctx);
+
 void jsonrpcFree(jsonrpc_t *rpc);
 
 #ifdef __cplusplus